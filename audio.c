@@ -38,38 +38,97 @@
 
 /**  INCLUDES  ****************************************************************/
 
+#include <inttypes.h>		/* PRIu64 */
+#include <pthread.h>
+#include <stdbool.h>		/* bool */
+#include <string.h>		/* memset */
+
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
-#include <portaudio.h>
 
+#include "contrib/pa_memorybarrier.h"
 #include "contrib/pa_ringbuffer.h"
 
 #include "audio.h"
 #include "audio_av.h"
-#include "audio_cb.h"		/* audio_cb_play */
+#include "audio_conv.h"		/* audio_conv_sum, audio_conv_mix */
+#include "audio_out.h"
 #include "constants.h"
+#include "counters.h"		/* struct decode_counters, counters_xyz */
+#include "workers.h"		/* workers_add, workers_remove, workers_wake */
 
 /**  DATA TYPES  **************************************************************/
 
+/* A crossfade from the end of one audio into the start of another. */
+struct xfade {
+	struct audio   *next;	/* Audio to fade into, or NULL for none */
+	size_t		len;	/* Length of the fade, in samples */
+	enum xfade_curve curve;	/* Shape of the fade */
+};
+
 struct audio {
 	enum error	last_err;	/* Last result of decoding */
 	struct au_in   *av;	/* ffmpeg state */
 	/* shared state */
-	char           *frame_ptr;
-	size_t		frame_samples;
+	size_t		frame_offset;	/* Samples used from current frame */
+	size_t		frame_samples;	/* Samples left in current frame */
 	/* PortAudio state */
 	PaUtilRingBuffer *ring_buf;
 	char           *ring_data;
-	PaStream       *out_strm;	/* Output stream */
-	int		device_id;	/* PortAudio device ID */
+	struct au_out  *out;	/* Output stream this audio plays on */
 	uint64_t	used_samples;	/* Counter of samples played */
+	/* Decoder state (the decoder runs on the worker pool) */
+	pthread_mutex_t	lock;	/* Protects the flags below */
+	pthread_cond_t	decoded;	/* Signalled by the decoder */
+	bool		decoder_running;	/* Is the decoder a worker job? */
+	bool		filling;	/* Is the decoder filling the ring? */
+	uint64_t	seek_usec;	/* Latest seek asked for */
+	unsigned int	seek_req;	/* Bumped for every seek asked for */
+	unsigned int	seek_done;	/* Value of seek_req last seeked for */
+	/* Seek marker, from decoder to consumer (see post_mark) */
+	volatile unsigned int mark_gen;	/* Odd while being written */
+	ring_buffer_size_t mark_index;	/* Ring write index at the seek */
+	uint64_t	mark_pos;	/* Position of the sample there */
+	volatile unsigned int mark_taken;	/* Last mark_gen consumer saw */
+	/* Seeks within the ring, from main thread to consumer */
+	volatile unsigned int nudge_gen;	/* Bumped for each nudge */
+	uint64_t	nudge_pos;	/* Position to nudge to */
+	volatile unsigned int nudge_taken;	/* Last nudge_gen consumer saw */
+	volatile unsigned int nudge_failed;	/* Last nudge_gen out of reach */
+	unsigned int	nudge_failed_seen;	/* Last nudge_failed handled */
+	/* Consumer state */
+	volatile size_t	history;	/* Valid samples behind read index */
+	size_t		fade;	/* Samples left of fade-in after a seek */
+	/* Crossfading into the next audio (see crossfade) */
+	struct xfade	xf_want;	/* Crossfade asked for, under 'lock' */
+	struct xfade	xf;	/* Decoder's copy of it while decoding */
+	size_t		xf_done;	/* Samples of the fade written so far */
+	bool		xf_tail;	/* Has our own file run out mid-fade? */
+	struct decode_counters counters;	/* Kept by the decoder */
 };
 
 /**  STATIC PROTOTYPES  *******************************************************/
 
-static enum error init_sink(struct audio *au, int device);
 static enum error init_ring_buf(struct audio *au, size_t bytes_per_sample);
 static enum error free_ring_buf(struct audio *au);
+static enum error decode(struct audio *au);
+static void	write_frames(struct audio *au, char *dst, size_t samples);
+static size_t	fade_start(struct audio *au, size_t count);
+static size_t	fade_room(struct audio *au, size_t count);
+static void	crossfade(struct audio *au, char *dst, size_t samples);
+static enum error start_decoder(struct audio *au);
+static void	stop_decoder(struct audio *au);
+static void	request_seek(struct audio *au);
+static bool	can_nudge(struct audio *au, uint64_t pos);
+static bool	check_nudge_failed(struct audio *au);
+static bool	take_mark(struct audio *au);
+static bool	take_nudge(struct audio *au);
+static void	seek_decoder(struct audio *au, uint64_t usec);
+static void	post_mark(struct audio *au, uint64_t pos);
+static bool	decoder_run(void *v_au);
+static bool	decoder_should_fill(struct audio *au, bool filling);
+static bool	decoder_more(struct audio *au);
+static size_t	ring_fill(struct audio *au);
 
 /**  PUBLIC FUNCTIONS  ********************************************************/
 
@@ -77,10 +136,15 @@ static enum error free_ring_buf(struct audio *au);
  * Loading and unloading
  *----------------------------------------------------------------------------*/
 
+/* Loads 'path' for playing on 'out', without attaching it (see audio_prime);
+ * this may take a while, so it can be run off the main thread, and will give
+ * up with E_INCOMPLETE if *cancel becomes true.
+ */
 enum error
 audio_load(struct audio **au,
 	   const char *path,
-	   int device)
+	   struct au_out *out,
+	   const volatile bool *cancel)
 {
 	enum error	err = E_OK;
 
@@ -93,28 +157,51 @@ audio_load(struct audio **au,
 		err = error(E_NO_MEM, "can't alloc audio structure");
 	if (err == E_OK) {
 		(*au)->last_err = E_INCOMPLETE;
-		err = audio_av_load(&((*au)->av), path);
+		(*au)->out = out;
+		err = audio_av_load(&((*au)->av),
+				    path,
+				    audio_out_sample_fmt(out),
+				    audio_out_channels(out),
+				    audio_out_sample_rate(out),
+				    true,
+				    cancel);
 	}
-	if (err == E_OK)
-		err = init_sink(*au, device);
 	if (err == E_OK)
 		err = init_ring_buf(*au, audio_av_samples2bytes((*au)->av, 1L));
+	if (err == E_OK)
+		err = start_decoder(*au);
 
 	return err;
 }
 
+/* Attaches loaded audio to its output and gets the output going.
+ *
+ * The decoder is already filling the ring in the background; the source is
+ * started now, paused, so that playing is just a matter of unpausing it.
+ */
+enum error
+audio_prime(struct audio *au)
+{
+	audio_out_attach(au->out, au);
+	return audio_out_start(au->out);
+}
+
 void
 audio_unload(struct audio *au)
 {
 	if (au != NULL) {
+		/* The callback pokes the decoder, and both use the ring and
+		 * ffmpeg state, so they must be gone in that order before
+		 * anything is freed.
+		 */
+		if (au->out != NULL && audio_out_attached(au->out) == au)
+			audio_out_detach(au->out);
+		stop_decoder(au);
+		if (au->out != NULL)
+			counters_add_decode(audio_out_decode_counters(au->out),
+					    &(au->counters));
 		free_ring_buf(au);
 		audio_av_unload(au->av);
-
-		if (au->out_strm != NULL) {
-			Pa_CloseStream(au->out_strm);
-			au->out_strm = NULL;
-			dbug("closed output stream");
-		}
 		free(au);
 	}
 }
@@ -123,38 +210,47 @@ audio_unload(struct audio *au)
  *  Playback control
  *----------------------------------------------------------------------------*/
 
+/* Starts, or resumes, playback.
+ *
+ * The source is started, paused, when the audio is loaded, and keeps running
+ * until the audio is unloaded or runs out, so this is normally just a matter
+ * of telling the callback to carry on from where it left off; the callback
+ * picks that up on its next run.  Only if the source has stopped for some
+ * reason is there any waiting to do.
+ */
 enum error
 audio_start(struct audio *au)
 {
-	PaError		pa_err;
 	enum error	err = E_OK;
 
-	err = audio_spin_up(au);
-	if (err == E_OK) {
-		pa_err = Pa_StartStream(au->out_strm);
-		if (pa_err)
-			err = error(E_INTERNAL_ERROR, "couldn't start stream");
-	}
+	if (!audio_out_active(au->out)) {
+		err = audio_spin_up(au);
+		audio_out_set_playing(au->out, true);
+		if (err == E_OK)
+			err = audio_out_start(au->out);
+		if (err != E_OK)
+			audio_out_set_playing(au->out, false);
+	} else
+		audio_out_set_playing(au->out, true);
 	if (err == E_OK)
 		dbug("audio started");
 
 	return err;
 }
 
+/* Pauses playback.
+ *
+ * The source carries on running, playing silence, and the ring buffer and
+ * decoder are left as they are, so nothing is lost and audio_start can pick up
+ * again straight away.
+ */
 enum error
 audio_stop(struct audio *au)
 {
-	PaError		pa_err;
-	enum error	err = E_OK;
-
-	pa_err = Pa_AbortStream(au->out_strm);
-	if (pa_err)
-		err = error(E_INTERNAL_ERROR, "couldn't stop stream");
-	else
-		dbug("audio stopped");
+	audio_out_set_playing(au->out, false);
+	dbug("audio stopped");
 
-	/* TODO: Possibly recover from dropping frames due to abort. */
-	return err;
+	return E_OK;
 }
 
 /*----------------------------------------------------------------------------
@@ -179,7 +275,7 @@ audio_halted(struct audio *au)
 {
 	enum error	err = E_OK;
 
-	if (!Pa_IsStreamActive(au->out_strm)) {
+	if (!audio_out_active(au->out)) {
 		err = au->last_err;
 		/* Abnormal stream halts with error being OK are weird... */
 		if (err == E_OK)
@@ -208,6 +304,12 @@ audio_ringbuf(struct audio *au)
 	return au->ring_buf;
 }
 
+const struct decode_counters *
+audio_decode_counters(struct audio *au)
+{
+	return &(au->counters);
+}
+
 size_t
 audio_samples2bytes(struct audio *au, size_t samples)
 {
@@ -218,8 +320,11 @@ audio_samples2bytes(struct audio *au, size_t samples)
  *  Spin-up
  *----------------------------------------------------------------------------*/
 
-/* Tries to place enough audio into the audio buffer to prevent a
- * buffer underrun during a player start.
+/* Waits until there is enough audio in the audio buffer to prevent a
+ * buffer underrun during a player start.  The output must be stopped.
+ *
+ * The decoding itself is done by the decoder thread; this just waits for it
+ * to get far enough.
  *
  * If end of file is reached, it is ignored and converted to E_OK so that it can
  * later be caught by the player callback once it runs out of sound.
@@ -227,23 +332,32 @@ audio_samples2bytes(struct audio *au, size_t samples)
 enum error
 audio_spin_up(struct audio *au)
 {
-	ring_buffer_size_t  c;
 	enum error	err;
-	PaUtilRingBuffer *r = au->ring_buf;
 
         /* Either fill the ringbuf or hit the maximum spin-up size,
          * whichever happens first.  (There's a maximum in order to
          * prevent spin-up from taking massive amounts of time and
          * thus delaying playback.)
          */
-	for (err = E_OK, c = PaUtil_GetRingBufferWriteAvailable(r);
-	     err == E_OK && (c > 0 && RINGBUF_SIZE - c < SPINUP_SIZE);
-	     err = audio_decode(au), c = PaUtil_GetRingBufferWriteAvailable(r));
+	pthread_mutex_lock(&au->lock);
+	workers_wake();
+	/* Anything in the ring from before a pending seek doesn't count; the
+	 * output is stopped, so we can throw it away ourselves.
+	 */
+	do {
+		while (au->seek_done != au->seek_req)
+			pthread_cond_wait(&au->decoded, &au->lock);
+		audio_take_seek(au);
+	} while (check_nudge_failed(au));
+	while (decoder_more(au) && ring_fill(au) < SPINUP_SIZE)
+		pthread_cond_wait(&au->decoded, &au->lock);
+	err = au->last_err;
+	pthread_mutex_unlock(&au->lock);
 
 	/* Allow EOF, this'll be caught by the player callback once it hits the
 	 * end of file itself
 	 */
-	if (err == E_EOF)
+	if (err == E_EOF || err == E_INCOMPLETE)
 		err = E_OK;
 
 	return err;
@@ -253,27 +367,91 @@ audio_spin_up(struct audio *au)
  *  Playback position
  *----------------------------------------------------------------------------*/
 
-/* Attempts to seek to the given position in microseconds. */
+/* Asks for a seek to the given position in microseconds.
+ *
+ * This returns straight away.  If the position is still in the ring buffer,
+ * either not yet played or within the SEEK_HISTORY_SAMPLES kept behind the
+ * playing position, the playing callback just skips to it.  Otherwise the
+ * decoder thread does a proper seek, and the callback switches over to the
+ * new position once the decoder has some audio from it, playing silence in
+ * between.  If several seeks come in before the decoder gets round to them,
+ * only the last one is done.
+ */
 enum error
 audio_seek_usec(struct audio *au, uint64_t usec)
 {
-	size_t		samples;
-	enum error	err = E_OK;
+	uint64_t	pos = audio_av_usec2samples(au->av, usec);
 
-	samples = audio_av_usec2samples(au->av, usec);
+	pthread_mutex_lock(&au->lock);
+	au->seek_usec = usec;
+	if (can_nudge(au, pos)) {
+		/* Only one nudge is ever in flight, so this can't tear */
+		au->nudge_pos = pos;
+		PaUtil_WriteMemoryBarrier();
+		au->nudge_gen++;
+	} else
+		request_seek(au);
+	pthread_mutex_unlock(&au->lock);
 
-	if (err == E_OK) {
-		while (!Pa_IsStreamStopped(au->out_strm));	/* Spin until stream
-								 * finishes */
-		PaUtil_FlushRingBuffer(au->ring_buf);
-		err = audio_av_seek(au->av, usec);
-	}
-	if (err == E_OK) {
-		au->frame_samples = 0;
-		au->last_err = E_INCOMPLETE;
-		au->used_samples = samples;	/* Update position marker */
+	return E_OK;
+}
+
+/* Switches over to the position of the last seek, if it hasn't been switched
+ * to already.  Returns true if there was a switch.
+ *
+ * This is the consumer side of the ring, so only the playing callback (or
+ * anyone else, if the output is stopped) may call it.  It never blocks.
+ */
+bool
+audio_take_seek(struct audio *au)
+{
+	bool		taken;
+
+	/* A decoder seek always comes after any nudge still in flight, and
+	 * throws away whatever the nudge would have skipped to.
+	 */
+	taken = take_mark(au);
+	if (!taken)
+		taken = take_nudge(au);
+	if (taken)
+		audio_start_fade(au);
+
+	return taken;
+}
+
+/* Starts a fade-in from the next sample played, to cover a jump in the audio.
+ *
+ * Consumer side only.
+ */
+void
+audio_start_fade(struct audio *au)
+{
+	au->fade = FADE_IN_SAMPLES;
+}
+
+/* Adds the 'samples' samples at 'src', straight out of the ring, into 'dst' at
+ * 'gain', fading in the first FADE_IN_SAMPLES samples played after a seek or
+ * resume, which would otherwise click.
+ *
+ * Like audio_take_seek, this is for the consumer side of the ring only.
+ */
+void
+audio_sum_out(struct audio *au, char *dst, const char *src, size_t samples,
+	      float gain)
+{
+	size_t		n = (samples < au->fade ? samples : au->fade);
+	size_t		bytes = audio_samples2bytes(au, n);
+	enum AVSampleFormat fmt = audio_out_sample_fmt(au->out);
+	int		chans = audio_out_channels(au->out);
+
+	if (n > 0) {
+		audio_conv_sum_ramp(fmt, chans, dst, src, n, gain,
+				    FADE_IN_SAMPLES - au->fade,
+				    FADE_IN_SAMPLES);
+		au->fade -= n;
 	}
-	return err;
+	audio_conv_sum(fmt, chans, dst + bytes, src + bytes, samples - n,
+		       gain);
 }
 
 /* Increments the used samples counter, which is used to determine the current
@@ -282,76 +460,596 @@ audio_seek_usec(struct audio *au, uint64_t usec)
 void
 audio_inc_used_samples(struct audio *au, uint64_t samples)
 {
+	size_t		history = au->history + (size_t)samples;
+
 	au->used_samples += samples;
+	/* What's just been played is kept for seeking back into */
+	au->history = (history < SEEK_HISTORY_SAMPLES ?
+		       history : SEEK_HISTORY_SAMPLES);
+}
+
+/*----------------------------------------------------------------------------
+ *  Crossfading
+ *----------------------------------------------------------------------------*/
+
+/* Asks for the end of this audio to be crossfaded, over 'usec' microseconds
+ * and following 'curve', into the start of 'next', which is cued up to
+ * follow on from it (see audio_out_cue).  A 'next' of NULL, or a 'usec' of 0,
+ * turns crossfading off.
+ *
+ * The mixing is done by our decoder, which reads the start of 'next' out of
+ * its ring as if it were the callback; by the time the callback hands over to
+ * 'next', it is just past the end of the fade.  Once this returns, our
+ * decoder will not touch any 'next' given before, so that can be freed.
+ */
+void
+audio_crossfade(struct audio *au,
+		struct audio *next,
+		uint64_t usec,
+		enum xfade_curve curve)
+{
+	pthread_mutex_lock(&au->lock);
+	au->xf_want.next = (usec > 0 ? next : NULL);
+	au->xf_want.len = audio_av_usec2samples(au->av, usec);
+	au->xf_want.curve = curve;
+	while (au->xf.next != NULL && au->xf.next != au->xf_want.next)
+		pthread_cond_wait(&au->decoded, &au->lock);
+	workers_wake();
+	pthread_mutex_unlock(&au->lock);
+}
+
+/*----------------------------------------------------------------------------
+ *  Decoder
+ *----------------------------------------------------------------------------*/
+
+/* Wakes the decoder if the ring buffer has drained below the low watermark.
+ *
+ * This is called from the playing callback, so it must not block; neither
+ * does workers_wake.
+ */
+void
+audio_check_low_water(struct audio *au)
+{
+	if (ring_fill(au) < DECODE_LOW_WATER)
+		workers_wake();
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/*----------------------------------------------------------------------------
+ *  Seeking
+ *----------------------------------------------------------------------------*/
+
+/* Hands the seek in seek_usec to the decoder.  Call with the lock held. */
+static void
+request_seek(struct audio *au)
+{
+	au->seek_req++;
+	/* If we've hit the end, the decoder is idle, and we don't want the
+	 * callback giving up before the decoder gets to the seek.
+	 */
+	if (!decoder_more(au))
+		au->last_err = E_INCOMPLETE;
+	workers_wake();
+}
+
+/* Decides whether a seek to sample 'pos' looks like it can be done by moving
+ * around in the ring.  Call with the lock held.
+ *
+ * The callback is moving through the ring as we look, so this can only be a
+ * good guess; take_nudge has the final say.
+ */
+static bool
+can_nudge(struct audio *au, uint64_t pos)
+{
+	uint64_t	used = au->used_samples;
+	bool		ok;
+
+	/* With a seek or nudge on the go, the ring is about to change under
+	 * us, so don't try to be clever.
+	 */
+	ok = (au->seek_done == au->seek_req &&
+	      au->mark_taken == au->mark_gen &&
+	      au->nudge_taken == au->nudge_gen);
+	if (ok && pos >= used)
+		ok = (pos - used < ring_fill(au));
+	else if (ok)
+		ok = (used - pos <= au->history);
+
+	return ok;
+}
+
+/* If the consumer couldn't do the last nudge, turns it into a proper seek.
+ * Call with the lock held.  Returns true if it did.
+ */
+static bool
+check_nudge_failed(struct audio *au)
+{
+	bool		failed = (au->nudge_failed != au->nudge_failed_seen);
+
+	if (failed) {
+		au->nudge_failed_seen = au->nudge_failed;
+		request_seek(au);
+	}
+	return failed;
+}
+
+/* If the decoder has posted a seek mark we haven't seen, throws away
+ * everything in the ring from before it.  Returns true if it did.
+ *
+ * Consumer side only.
+ */
+static bool
+take_mark(struct audio *au)
+{
+	unsigned int	gen;
+	ring_buffer_size_t index;
+	ring_buffer_size_t ahead;
+	uint64_t	pos;
+	bool		taken = false;
+	PaUtilRingBuffer *rb = au->ring_buf;
+
+	/* The decoder bumps mark_gen before and after writing the mark, so if
+	 * it is odd or changes while we read, we've caught it half-written and
+	 * will pick it up next time.
+	 */
+	gen = au->mark_gen;
+	PaUtil_ReadMemoryBarrier();
+	if (gen % 2 == 0 && gen != au->mark_taken) {
+		index = au->mark_index;
+		pos = au->mark_pos;
+		PaUtil_ReadMemoryBarrier();
+		taken = (au->mark_gen == gen);
+	}
+	if (taken) {
+		/* We may have already played a little past the mark if the
+		 * decoder got audio in before we saw it.
+		 */
+		ahead = (index - rb->readIndex) & rb->bigMask;
+		if (ahead <= PaUtil_GetRingBufferReadAvailable(rb)) {
+			PaUtil_AdvanceRingBufferReadIndex(rb, ahead);
+			au->used_samples = pos;
+		} else
+			au->used_samples =
+				pos + (uint64_t)((rb->readIndex - index) &
+						 rb->bigMask);
+		/* What's behind us now is from before the seek */
+		au->history = 0;
+		au->mark_taken = gen;
+		/* Any nudge still in flight was for before the seek too */
+		au->nudge_taken = au->nudge_gen;
+	}
+	return taken;
+}
+
+/* If there is a nudge we haven't seen, moves the read index to it, or, if it
+ * has gone out of reach since audio_seek_usec looked, gets the decoder to do
+ * a proper seek instead.  Returns true if the read index moved.
+ *
+ * Consumer side only.
+ */
+static bool
+take_nudge(struct audio *au)
+{
+	unsigned int	gen = au->nudge_gen;
+	uint64_t	pos;
+	size_t		n;
+	bool		taken = false;
+	PaUtilRingBuffer *rb = au->ring_buf;
+
+	if (gen != au->nudge_taken) {
+		PaUtil_ReadMemoryBarrier();
+		pos = au->nudge_pos;
+		if (pos >= au->used_samples) {
+			n = (size_t)(pos - au->used_samples);
+			taken = (n < ring_fill(au));
+			if (taken) {
+				PaUtil_AdvanceRingBufferReadIndex(rb,
+				    (ring_buffer_size_t)n);
+				au->history = (au->history + n <
+					       SEEK_HISTORY_SAMPLES ?
+					       au->history + n :
+					       SEEK_HISTORY_SAMPLES);
+			}
+		} else {
+			/* The decoder never writes into the history, so
+			 * we can step back into it.
+			 */
+			n = (size_t)(au->used_samples - pos);
+			taken = (n <= au->history);
+			if (taken) {
+				PaUtil_AdvanceRingBufferReadIndex(rb,
+				    -(ring_buffer_size_t)n);
+				au->history -= n;
+			}
+		}
+		if (taken)
+			au->used_samples = pos;
+		else {
+			au->nudge_failed = gen;
+			workers_wake();
+		}
+		au->nudge_taken = gen;
+	}
+	return taken;
 }
 
 /*----------------------------------------------------------------------------
  *  Decoding
  *----------------------------------------------------------------------------*/
 
-enum error
-audio_decode(struct audio *au)
+/* Does one frame's worth of decoding work.
+ *
+ * Only the decoder thread may call this.
+ */
+static enum error
+decode(struct audio *au)
 {
 	unsigned long	cap;
 	unsigned long	count;
+	size_t		start;
+	uint64_t	nsecs;
 	enum error	err = E_OK;
 
-	if (au->frame_samples == 0) {
+	if (au->frame_samples == 0 && !au->xf_tail) {
 		/* We need to decode some new frames! */
-		err = audio_av_decode(au->av,
-				      &(au->frame_ptr),
-				      &(au->frame_samples));
+		nsecs = counters_nsecs();
+		err = audio_av_decode(au->av, &(au->frame_samples));
+		au->counters.nsecs += counters_nsecs() - nsecs;
+		if (err == E_OK) {
+			au->counters.frames++;
+			au->counters.samples += au->frame_samples;
+		}
+		au->frame_offset = 0;
+		/* If the file ends mid-crossfade, the rest of the fade
+		 * is just the next audio fading in.
+		 */
+		if (err == E_EOF && au->xf.next != NULL && au->xf_done > 0)
+			au->xf_tail = true;
+	}
+	if (au->xf_tail) {
+		/* Unless the fade has been called off since */
+		au->frame_samples = (au->xf.next != NULL ?
+				     au->xf.len - au->xf_done : 0);
+		err = (au->frame_samples > 0 ? E_OK : E_EOF);
 	}
+	/* Leave what was just played alone, in case we want to seek back
+	 * into it.
+	 */
 	cap = (unsigned long)PaUtil_GetRingBufferWriteAvailable(au->ring_buf);
+	cap = (cap > SEEK_HISTORY_SAMPLES ? cap - SEEK_HISTORY_SAMPLES : 0);
 	count = (cap < au->frame_samples ? cap : au->frame_samples);
+	start = fade_start(au, (size_t)count);
+	if (start < count)
+		count = start + fade_room(au, (size_t)(count - start));
 	if (count > 0 && err == E_OK) {
 		/*
-		 * We can copy some already decoded samples into the ring
-		 * buffer
+		 * We can move some already decoded samples into the ring
+		 * buffer.  We write straight into the ring's memory, which
+		 * may be split in two where it wraps around.
 		 */
-		unsigned long	num_written;
-
-		num_written = PaUtil_WriteRingBuffer(au->ring_buf,
-						     au->frame_ptr,
-						 (ring_buffer_size_t)count);
-		if (num_written != count)
-			err = error(E_INTERNAL_ERROR, "ringbuf write error");
+		void           *r1;
+		void           *r2;
+		ring_buffer_size_t n1;
+		ring_buffer_size_t n2;
 
-		au->frame_samples -= num_written;
-		au->frame_ptr += audio_av_samples2bytes(au->av, num_written);
+		PaUtil_GetRingBufferWriteRegions(au->ring_buf,
+						 (ring_buffer_size_t)count,
+						 &r1, &n1, &r2, &n2);
+		write_frames(au, (char *)r1, (size_t)n1);
+		write_frames(au, (char *)r2, (size_t)n2);
+		/* Mix in the next audio from where the fade starts */
+		if (start < (size_t)n1)
+			crossfade(au,
+				  (char *)r1 + audio_samples2bytes(au, start),
+				  (size_t)n1 - start);
+		crossfade(au,
+			  (char *)r2 + audio_samples2bytes(au,
+				  (start > (size_t)n1 ? start - (size_t)n1 : 0)),
+			  (start > (size_t)n1 ?
+			   (size_t)(n1 + n2) - start : (size_t)n2));
+		PaUtil_AdvanceRingBufferWriteIndex(au->ring_buf, n1 + n2);
+	}
+	/* Once the fade is over, what's left of our file is never heard */
+	if (au->xf.next != NULL && au->xf_done > 0 &&
+	    au->xf_done >= au->xf.len) {
+		au->frame_samples = 0;
+		au->xf_tail = false;
+		err = E_EOF;
 	}
 	au->last_err = err;
 	return err;
 }
 
-/**  STATIC FUNCTIONS  ********************************************************/
+/* Moves 'samples' samples from the current decoded frame into the ring buffer
+ * region 'dst', and advances past them in the frame.
+ *
+ * Any interleaving or format conversion happens on the way in, so the samples
+ * are touched exactly once.
+ */
+static void
+write_frames(struct audio *au, char *dst, size_t samples)
+{
+	if (samples > 0) {
+		/* Past the end of our file, there's only the fade-in */
+		if (au->xf_tail)
+			memset(dst, 0, audio_samples2bytes(au, samples));
+		else
+			audio_av_convert(au->av, dst, au->frame_offset,
+					 samples);
+		au->frame_offset += samples;
+		au->frame_samples -= samples;
+	}
+}
+
+/*----------------------------------------------------------------------------
+ *  Crossfading
+ *----------------------------------------------------------------------------*/
+
+/* Works out how far into the next 'count' samples to be written the
+ * crossfade starts, returning 'count' if it doesn't start in them.
+ *
+ * The fade starts its length before the end of our file.  If the file's
+ * length isn't known there is no fade, just a gapless handover; if it is
+ * wrong, the fade is cut short or finishes with the next audio alone.
+ */
+static size_t
+fade_start(struct audio *au, size_t count)
+{
+	uint64_t	length;
+	uint64_t	pos;
+	uint64_t	start;
+	size_t		offset = count;
 
+	if (au->xf.next == NULL || au->xf.len == 0)
+		offset = count;
+	else if (au->xf_done > 0 || au->xf_tail)
+		offset = 0;
+	else {
+		length = audio_av_length(au->av);
+		pos = audio_av_position(au->av) + au->frame_offset;
+		start = (length > au->xf.len ? length - au->xf.len : 0);
+		if (length == UINT64_MAX || pos + count <= start)
+			offset = count;
+		else if (pos >= start)
+			offset = 0;
+		else
+			offset = (size_t)(start - pos);
+	}
+	return offset;
+}
+
+/* Limits 'count' samples of crossfade to what is left of the fade and what
+ * the next audio has ready for us.
+ */
+static size_t
+fade_room(struct audio *au, size_t count)
+{
+	size_t		ready = ring_fill(au->xf.next);
+
+	if (count > au->xf.len - au->xf_done)
+		count = au->xf.len - au->xf_done;
+	if (count > ready)
+		count = ready;
+	return count;
+}
+
+/* Crossfades the 'samples' samples just written at 'dst' into the next
+ * 'samples' samples from the next audio's ring.
+ *
+ * This takes the samples out of the next audio's ring as the callback would,
+ * which is safe as nothing else reads that ring until the callback hands over
+ * to it, and that only happens once we've finished.
+ */
+static void
+crossfade(struct audio *au, char *dst, size_t samples)
+{
+	void           *r[2];
+	ring_buffer_size_t n[2];
+	int		i;
+	struct audio   *next = au->xf.next;
+
+	if (samples > 0) {
+		PaUtil_GetRingBufferReadRegions(next->ring_buf,
+						(ring_buffer_size_t)samples,
+						&r[0], &n[0], &r[1], &n[1]);
+		for (i = 0; i < 2; i++) {
+			audio_conv_mix(audio_out_sample_fmt(au->out),
+				       audio_out_channels(au->out),
+				       dst,
+				       (const char *)r[i],
+				       (size_t)n[i],
+				       au->xf_done,
+				       au->xf.len,
+				       au->xf.curve);
+			dst += audio_samples2bytes(au, (size_t)n[i]);
+			au->xf_done += (size_t)n[i];
+		}
+		PaUtil_AdvanceRingBufferReadIndex(next->ring_buf, n[0] + n[1]);
+		audio_inc_used_samples(next, (uint64_t)(n[0] + n[1]));
+		audio_check_low_water(next);
+	}
+}
+
+/*----------------------------------------------------------------------------
+ *  The decoder
+ *----------------------------------------------------------------------------*/
+
+/* Starts the decoder, which immediately begins filling the ring. */
 static enum error
-init_sink(struct audio *au, int device)
+start_decoder(struct audio *au)
 {
-	PaError		pa_err;
-	double		sample_rate;
-	size_t		samples_per_buf;
-	PaStreamParameters pars;
 	enum error	err = E_OK;
 
-	sample_rate = audio_av_sample_rate(au->av);
-
-	err = audio_av_pa_config(au->av, device, &pars, &samples_per_buf);
-	pa_err = Pa_OpenStream(&au->out_strm,
-			       NULL,
-			       &pars,
-			       sample_rate,
-			       samples_per_buf,
-			       paClipOff,
-			       audio_cb_play,
-			       (void *)au);
-	if (pa_err)
-		err = error(E_AUDIO_INIT_FAIL, "couldn't open stream");
+	if (pthread_mutex_init(&au->lock, NULL) != 0)
+		err = error(E_INTERNAL_ERROR, "couldn't init decoder lock");
+	if (err == E_OK && pthread_cond_init(&au->decoded, NULL) != 0)
+		err = error(E_INTERNAL_ERROR, "couldn't init decoder cond");
+	if (err == E_OK) {
+		au->filling = true;
+		err = workers_add(decoder_run, (void *)au);
+	}
+	if (err == E_OK)
+		au->decoder_running = true;
 
 	return err;
 }
 
+/* Stops the decoder, waiting for it if it is in the middle of something. */
+static void
+stop_decoder(struct audio *au)
+{
+	if (au->decoder_running) {
+		workers_remove((void *)au);
+		au->decoder_running = false;
+
+		pthread_cond_destroy(&au->decoded);
+		pthread_mutex_destroy(&au->lock);
+		dbug("stopped decoder");
+	}
+}
+
+/* Does a turn of the decoder's work, as a job on the worker pool (see
+ * workers.c).  Returns true if there was anything to do.
+ *
+ * The decoder rests until the ring buffer drains below DECODE_LOW_WATER, then
+ * decodes in bulk until it fills past DECODE_HIGH_WATER.  The lock is not held
+ * while decoding, so that commands and the spin-up never wait on the decoder.
+ */
+static bool
+decoder_run(void *v_au)
+{
+	uint64_t	usec;
+	unsigned int	gen;
+	ring_buffer_size_t index;
+	struct audio   *au = (struct audio *)v_au;
+	bool		busy = true;
+
+	pthread_mutex_lock(&au->lock);
+	check_nudge_failed(au);
+	if (au->seek_done != au->seek_req) {
+		/* Seeks come first, as they make everything else we might do
+		 * pointless.
+		 */
+		gen = au->seek_req;
+		usec = au->seek_usec;
+		pthread_mutex_unlock(&au->lock);
+		seek_decoder(au, usec);
+		pthread_mutex_lock(&au->lock);
+		au->seek_done = gen;
+		au->filling = true;
+		pthread_cond_broadcast(&au->decoded);
+	} else if (decoder_should_fill(au, au->filling) && decoder_more(au)) {
+		au->filling = true;
+		au->xf = au->xf_want;
+		index = au->ring_buf->writeIndex;
+		pthread_mutex_unlock(&au->lock);
+		decode(au);
+		pthread_mutex_lock(&au->lock);
+		au->xf.next = NULL;
+		pthread_cond_broadcast(&au->decoded);
+		/* A crossfade can't get ahead of the next audio's decoder;
+		 * if it has caught up, give it a moment.
+		 */
+		busy = (au->ring_buf->writeIndex != index || !decoder_more(au));
+	} else {
+		/* Nothing to do until the ring drains, or (if we've hit the
+		 * end) someone seeks or unloads.
+		 */
+		if (decoder_more(au))
+			au->filling = false;
+		busy = false;
+	}
+	pthread_mutex_unlock(&au->lock);
+
+	return busy;
+}
+
+/* Seeks the decoder to 'usec' microseconds in, then marks the place in the
+ * ring where audio from the new position starts (see audio_take_seek).
+ *
+ * The first frame is decoded here, so the mark can say where decoding really
+ * landed, but not written to the ring until after the mark.
+ */
+static void
+seek_decoder(struct audio *au, uint64_t usec)
+{
+	uint64_t	pos = audio_av_usec2samples(au->av, usec);
+	enum error	err = E_OK;
+
+	au->frame_samples = 0;
+	au->frame_offset = 0;
+	/* Any crossfade starts afresh from the new position */
+	au->xf_done = 0;
+	au->xf_tail = false;
+	err = audio_av_seek(au->av, usec);
+	if (err == E_OK)
+		err = audio_av_decode(au->av, &(au->frame_samples));
+	if (err == E_OK)
+		pos = audio_av_position(au->av);
+	else
+		au->frame_samples = 0;
+	/* Seeking past the end lands on EOF, which isn't our problem until
+	 * the callback runs out of sound.
+	 */
+	au->last_err = err;
+
+	post_mark(au, pos);
+	dbug("seeked to sample %" PRIu64, pos);
+}
+
+/* Tells the consumer side of the ring that everything written so far is from
+ * before a seek, and the next sample written is at position 'pos'.
+ *
+ * The decoder never waits for the consumer to see this (if the output is
+ * stopped, that could take forever), so a later seek may overwrite an unseen
+ * mark; that's fine, as the later mark covers everything the earlier one did.
+ * mark_gen makes sure the consumer never sees half of one mark and half of
+ * another.
+ */
+static void
+post_mark(struct audio *au, uint64_t pos)
+{
+	au->mark_gen++;
+	PaUtil_WriteMemoryBarrier();
+	au->mark_index = au->ring_buf->writeIndex;
+	au->mark_pos = pos;
+	PaUtil_WriteMemoryBarrier();
+	au->mark_gen++;
+}
+
+/* Decides whether the decoder should be filling the ring buffer, given
+ * whether it was filling it before.
+ */
+static bool
+decoder_should_fill(struct audio *au, bool filling)
+{
+	size_t		fill = ring_fill(au);
+
+	if (filling && fill >= DECODE_HIGH_WATER)
+		filling = false;
+	else if (!filling && fill < DECODE_LOW_WATER)
+		filling = true;
+
+	return filling;
+}
+
+/* Returns whether there is anything left for the decoder to decode, ie
+ * whether it hasn't yet hit end of file or an error.
+ */
+static bool
+decoder_more(struct audio *au)
+{
+	return au->last_err == E_OK || au->last_err == E_INCOMPLETE;
+}
+
+/* Returns the number of samples currently waiting in the ring buffer. */
+static size_t
+ring_fill(struct audio *au)
+{
+	return (size_t)PaUtil_GetRingBufferReadAvailable(au->ring_buf);
+}
+
 /*----------------------------------------------------------------------------
  *  The ring buffer
  *----------------------------------------------------------------------------*/
@@ -39,12 +39,17 @@
 
 /**  INCLUDES  ****************************************************************/
 
+#include <stdbool.h>		/* bool */
 #include <stdint.h>		/* uint64_t */
 
+
 #include "contrib/pa_ringbuffer.h"	/* PaUtilRingBuffer */
 
 #include "cuppa/errors.h"		/* enum error */
 
+#include "audio_conv.h"		/* enum xfade_curve */
+#include "audio_out.h"		/* struct au_out */
+
 /**  DATA TYPES  **************************************************************/
 
 /* The audio structure contains all state pertaining to the currently
@@ -63,12 +68,13 @@ struct audio;
 enum error
 audio_load(struct audio **au,	/* Location for the audio struct pointer */
 	   const char *path,	/* File to load into the audio struct */
-	   int device);		/* ID of the device to play out on */
+	   struct au_out *out,	/* Output the audio will be played on */
+	   const volatile bool *cancel);	/* Give up when this goes true */
 void		audio_unload(struct audio *au);	/* Frees an audio struct */
+enum error	audio_prime(struct audio *au);	/* Attaches to output */
 
 enum error	audio_start(struct audio *au);	/* Starts playback */
 enum error	audio_stop(struct audio *au);	/* Stops playback */
-enum error	audio_decode(struct audio *au);	/* Does some decoding work */
 
 enum error	audio_error(struct audio *au);	/* Gets last playback error */
 enum error	audio_halted(struct audio *au);	/* Has stream halted itself? */
@@ -76,10 +82,30 @@ uint64_t	audio_usec(struct audio *au);	/* Current time in song */
 PaUtilRingBuffer *audio_ringbuf(struct audio *au);	/* Get ring buffer */
 
 enum error	audio_seek_usec(struct audio *au, uint64_t usec);
+bool		audio_take_seek(struct audio *au);	/* Switch to seek? */
+void		audio_start_fade(struct audio *au);	/* Fade in from here */
+void
+audio_sum_out(struct audio *au,	/* Audio being played */
+	      char *dst,	/* Mix to add to */
+	      const char *src,	/* Samples read from the ring */
+	      size_t samples,	/* Number of samples at 'src' */
+	      float gain);	/* Gain to add them at */
 void		audio_inc_used_samples(struct audio *au, uint64_t samples);
+void		audio_check_low_water(struct audio *au);	/* Wake decoder? */
+
+void
+audio_crossfade(struct audio *au,	/* Audio to fade out of */
+		struct audio *next,	/* Cued audio to fade into */
+		uint64_t usec,	/* Length of fade */
+		enum xfade_curve curve);	/* Shape of fade */
 
 enum error audio_spin_up(struct audio *au);
 
 size_t audio_samples2bytes(struct audio *au, size_t samples);
 
+/* The decoder's health counters, which are added to its output's once the
+ * audio is unloaded.
+ */
+const struct decode_counters *audio_decode_counters(struct audio *au);
+
 #endif				/* not AUDIO_H */
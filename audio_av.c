@@ -39,19 +39,27 @@
 
 /**  INCLUDES  ****************************************************************/
 
+#include <inttypes.h>		/* SCNx64 */
+#include <stdbool.h>		/* bool */
+#include <stdio.h>		/* sscanf */
 #include <stdlib.h>
 
 /* ffmpeg */
 #include <libavcodec/avcodec.h>
 #include <libavcodec/version.h>		/* For old version patchups */
 #include <libavformat/avformat.h>
-
-#include <portaudio.h>
+#include <libavformat/version.h>	/* For old version patchups */
+#include <libavutil/dict.h>		/* av_dict_get */
+#include <libavutil/intreadwrite.h>	/* AV_RL32, AV_WL32 */
+#include <libavutil/mathematics.h>	/* av_rescale_q */
 
 #include "cuppa/errors.h"               /* dbug, error */
 #include "cuppa/constants.h"            /* USECS_IN_SEC */
 
 #include "audio_av.h"
+#include "audio_conv.h"		/* struct au_conv, audio_conv_xyz */
+#include "audio_index.h"		/* struct au_index, audio_index_xyz */
+#include "audio_rs.h"		/* struct au_rs, audio_rs_xyz */
 #include "constants.h"
 
 /**  DATA TYPES  **************************************************************/
@@ -63,20 +71,45 @@ struct au_in {
 	AVFrame        *frame;	/* Last decoded frame */
 	unsigned char  *buffer;
 	int		stream_id;
+	struct au_index *index;	/* Seek index, if there is one */
+	struct au_conv *conv;	/* Gets samples out of frames */
+	enum AVSampleFormat out_fmt;	/* Sample format 'conv' produces */
+	int		out_chans;	/* Channel count 'conv' produces */
+	double		out_rate;	/* Sample rate samples are produced at */
+	struct au_rs   *rs;	/* Resampler, if file rate != out_rate */
+	uint8_t *const *data;	/* Samples for 'conv' (frame or resampler) */
+	size_t		skip;	/* Samples at start of 'data' to ignore */
+	bool		flushed;	/* Has the resampler been drained? */
+	/* Position tracking, in samples at out_rate */
+	uint64_t	pos;	/* Position of first sample handed out */
+	uint64_t	next;	/* Position of the sample after the last one */
+	uint64_t	target;	/* Position a seek is trying to reach */
+	bool		seeking;	/* Throw away samples before 'target'? */
+	bool		resync;	/* Take 'next' from the next frame's pts? */
+	/* Encoder delay and padding, in samples at out_rate */
+	uint64_t	delay;	/* Priming samples at the start, to trim */
+	uint64_t	length;	/* Real samples after them, or UINT64_MAX */
 };
 
 /**  STATIC PROTOTYPES  *******************************************************/
 
-static enum error au_load_file(struct au_in *av, const char *path);
+static enum error au_load_file(struct au_in *av, const char *path,
+			       const volatile bool *cancel);
+static int	load_cancelled(void *v_cancel);
 static enum error au_init_stream(struct au_in *av);
 static enum error au_init_codec(struct au_in *av, int stream, AVCodec *codec);
 static enum error au_init_frame(struct au_in *av);
 static enum error au_init_packet(AVPacket **packet, uint8_t *buffer);
-static enum error decode_packet(struct au_in *av, char **buf, size_t *n);
-static enum error conv_sample_fmt(enum AVSampleFormat in, PaSampleFormat *out);
-static enum error
-setup_pa(PaSampleFormat sf, int device,
-	 int chans, PaStreamParameters *pars);
+static enum error au_init_conv(struct au_in *av);
+static enum error decode_packet(struct au_in *av, size_t *n);
+static enum error resample(struct au_in *av, uint8_t *const *in, size_t *n);
+static bool	index_seek(struct au_in *av, int64_t seek_pos);
+static void	sync_position(struct au_in *av);
+static uint64_t	ts2samples(struct au_in *av, int64_t ts);
+static enum error trim(struct au_in *av, size_t *n);
+static void	au_init_trim(struct au_in *av);
+static void	take_skip(struct au_in *av, size_t frame_samples);
+static uint64_t	file2out(struct au_in *av, uint64_t samples);
 
 /* Plaster over the lack of avcodec_free_frame in older ffmpeg
  * (see below in statics for implementation)
@@ -88,6 +121,16 @@ static void avcodec_free_frame(AVFrame **frame);
 # endif /* LIBAVCODEC_VERSION_MAJOR > 54 || LIBAVCODEC_VERSION_MAJOR < 28 */
 #endif /* LIBAVCODEC_VERSION_MAJOR < 55 */
 
+/* Packets only carry encoder delay and padding as side data in newer ffmpeg */
+#if LIBAVCODEC_VERSION_MAJOR >= 54
+# define HAVE_SKIP_SIDE_DATA
+#endif /* LIBAVCODEC_VERSION_MAJOR >= 54 */
+
+/* Newer ffmpeg applies MP4 edit lists itself, which covers iTunSMPB */
+#if LIBAVFORMAT_VERSION_MAJOR < 57
+# define HAVE_ITUNSMPB
+#endif /* LIBAVFORMAT_VERSION_MAJOR < 57 */
+
 /**  PUBLIC FUNCTIONS  ********************************************************/
 
 /*-----------------------------------------------------------------------------
@@ -95,7 +138,13 @@ static void avcodec_free_frame(AVFrame **frame);
  *----------------------------------------------------------------------------*/
 
 enum error
-audio_av_load(struct au_in **av, const char *path)
+audio_av_load(struct au_in **av,
+	      const char *path,
+	      enum AVSampleFormat fmt,
+	      int chans,
+	      double rate,
+	      bool seekable,
+	      const volatile bool *cancel)
 {
 	enum error	err = E_OK;
 
@@ -104,7 +153,7 @@ audio_av_load(struct au_in **av, const char *path)
 		audio_av_unload(*av);
 	}
 	*av = calloc((size_t)1, sizeof(struct au_in));
-	if (av == NULL)
+	if (*av == NULL)
 		err = error(E_NO_MEM, "couldn't alloc au_in structure");
 	if (err == E_OK) {
 		(*av)->buffer = calloc(BUFFER_SIZE, sizeof(char));
@@ -112,9 +161,28 @@ audio_av_load(struct au_in **av, const char *path)
 			err = error(E_NO_MEM, "couldn't alloc decode buffer");
 	}
 	if (err == E_OK)
-		err = au_load_file(*av, path);
+		err = au_load_file(*av, path, cancel);
 	if (err == E_OK)
 		err = au_init_stream(*av);
+	if (err != E_OK && cancel != NULL && *cancel)
+		err = E_INCOMPLETE;
+	/* The cancel flag won't be around for long after we return */
+	if (*av != NULL && (*av)->context != NULL)
+		(*av)->context->interrupt_callback.callback = NULL;
+	/* Seeking works without the index, just not as well */
+	if (err == E_OK && seekable &&
+	    audio_index_open(&((*av)->index), path, (*av)->stream_id) != E_OK) {
+		audio_index_close((*av)->index);
+		(*av)->index = NULL;
+	}
+	if (err == E_OK) {
+		(*av)->out_fmt = fmt;
+		(*av)->out_chans = chans;
+		(*av)->out_rate = rate;
+		(*av)->resync = true;
+		au_init_trim(*av);
+		err = au_init_conv(*av);
+	}
 	if (err == E_OK)
 		err = au_init_packet(&((*av)->packet), (*av)->buffer);
 	if (err == E_OK)
@@ -130,6 +198,9 @@ void
 audio_av_unload(struct au_in *av)
 {
 	if (av != NULL) {
+		/* The indexer may still be reading the file */
+		audio_index_close(av->index);
+		av->index = NULL;
 		dbug("freeing frame...");
 		avcodec_free_frame(&(av->frame));
 		if (av->packet != NULL) {
@@ -148,42 +219,65 @@ audio_av_unload(struct au_in *av)
 			av->buffer = NULL;
 			dbug("closed decode buffer");
 		}
+		audio_conv_free(av->conv);
+		av->conv = NULL;
+		audio_rs_free(av->rs);
+		av->rs = NULL;
 	}
 }
 
-/*----------------------------------------------------------------------------
- *  Interoperability with PortAudio
- *----------------------------------------------------------------------------*/
-
-enum error
-audio_av_pa_config(struct au_in *av,
-		   int device,
-		   PaStreamParameters *params,
-		   size_t *samples_per_buf)
-{
-	PaSampleFormat	sf;
-	enum error	err = E_OK;
-
-	*samples_per_buf = audio_av_bytes2samples(av, BUFFER_SIZE);
-
-	err = conv_sample_fmt(av->stream->codec->sample_fmt, &sf);
-	if (err == E_OK)
-		err = setup_pa(sf, device, av->stream->codec->channels, params);
-
-	return err;
-}
-
 /*----------------------------------------------------------------------------
  *  Simple accessors
  *----------------------------------------------------------------------------*/
 
 /* Returns the sample rate, providing av points to a properly initialised
  * au_in.
+ *
+ * This is the rate of the samples audio_av_convert hands out, which is the
+ * output's rate whatever the file's own rate is.
  */
 double
 audio_av_sample_rate(struct au_in *av)
 {
-	return (double)av->stream->codec->sample_rate;
+	return av->out_rate;
+}
+
+/* Returns the position in the file, in samples, of the first sample handed out
+ * by the last successful audio_av_decode.  Position 0 is the first real sample
+ * of the file, after any encoder delay.
+ *
+ * This comes from the file's own timestamps where it has them, so it reflects
+ * where decoding actually landed after a seek rather than where it was asked
+ * to go.
+ */
+uint64_t
+audio_av_position(struct au_in *av)
+{
+	return av->pos;
+}
+
+/* Returns the length of the file, in samples, or UINT64_MAX if it isn't
+ * known.
+ *
+ * This is exact if the file declares its padding; otherwise it is ffmpeg's
+ * idea of the stream's duration, which may only be an estimate.
+ */
+uint64_t
+audio_av_length(struct au_in *av)
+{
+	int64_t		length;
+	uint64_t	samples = av->length;
+
+	if (samples == UINT64_MAX &&
+	    av->stream->duration != AV_NOPTS_VALUE &&
+	    av->stream->duration > 0) {
+		length = av_rescale_q(av->stream->duration,
+				      av->stream->time_base,
+				      (AVRational){1, (int)av->out_rate});
+		if ((uint64_t)length > av->delay)
+			samples = (uint64_t)length - av->delay;
+	}
+	return samples;
 }
 
 /*----------------------------------------------------------------------------
@@ -204,13 +298,17 @@ audio_av_samples2usec(struct au_in *av, size_t samples)
 	return (samples * USECS_IN_SEC) / audio_av_sample_rate(av);
 }
 
-/* Converts buffer size (in bytes) to sample count (in samples). */
+/* Converts buffer size (in bytes) to sample count (in samples).
+ *
+ * This, and audio_av_samples2bytes, work in terms of converted samples (see
+ * audio_av_convert), not whatever the codec produces.
+ */
 size_t
 audio_av_bytes2samples(struct au_in *av, size_t bytes)
 {
 	return (bytes /
-		av->stream->codec->channels /
-		av_get_bytes_per_sample(av->stream->codec->sample_fmt));
+		av->out_chans /
+		av_get_bytes_per_sample(av->out_fmt));
 }
 
 /* Converts sample count (in samples) to buffer size (in bytes). */
@@ -218,29 +316,57 @@ size_t
 audio_av_samples2bytes(struct au_in *av, size_t samples)
 {
 	return (samples *
-		av->stream->codec->channels *
-		av_get_bytes_per_sample(av->stream->codec->sample_fmt));
+		av->out_chans *
+		av_get_bytes_per_sample(av->out_fmt));
 }
 
 /*----------------------------------------------------------------------------
  *  Seeking
  *----------------------------------------------------------------------------*/
 
-/* Attempts to seek to the position 'samples' samples into the file. */
+/* Seeks to the position 'usec' microseconds into the file.
+ *
+ * This is sample-accurate: the demuxer is sent to the last keyframe at or
+ * before 'usec' (straight to it, if the file's seek index is ready), and
+ * audio_av_decode then decodes and throws away everything up to the exact
+ * sample asked for.  Use audio_av_position afterwards to find
+ * out where decoding really restarted (it may be later if the file ends, or
+ * has no keyframe early enough).
+ */
 enum error
 audio_av_seek(struct au_in *av, uint64_t usec)
 {
 	int64_t		seek_pos;
 	enum error	err = E_OK;
 
-	seek_pos = ((usec * av->stream->time_base.den) /
-			av->stream->time_base.num) / USECS_IN_SEC;
-	if (av_seek_frame(av->context,
+	seek_pos = av_rescale_q((int64_t)usec,
+				AV_TIME_BASE_Q,
+				av->stream->time_base);
+	/* The file's timestamps count the encoder delay; we don't */
+	seek_pos += av_rescale_q((int64_t)av->delay,
+				 (AVRational){1, (int)av->out_rate},
+				 av->stream->time_base);
+	if (av->stream->start_time != AV_NOPTS_VALUE)
+		seek_pos += av->stream->start_time;
+	av->resync = true;
+	if (!index_seek(av, seek_pos) &&
+	    av_seek_frame(av->context,
 			  av->stream_id,
-			  (int64_t)seek_pos,
-			  AVSEEK_FLAG_ANY) != 0)
+			  seek_pos,
+			  AVSEEK_FLAG_BACKWARD) < 0)
 		err = error(E_INTERNAL_ERROR, "seek failed");
-
+	if (err == E_OK) {
+		/* Anything the decoder (or resampler) was holding on to from
+		 * before the seek would otherwise come out after it.
+		 */
+		avcodec_flush_buffers(av->stream->codec);
+		if (av->rs != NULL) {
+			audio_rs_reset(av->rs);
+			av->flushed = false;
+		}
+		av->target = audio_av_usec2samples(av, usec);
+		av->seeking = true;
+	}
 	return err;
 }
 
@@ -248,19 +374,19 @@ audio_av_seek(struct au_in *av, uint64_t usec)
  *  Decoding frames
  *----------------------------------------------------------------------------*/
 
-/* Tries to decode an entire frame and points to its contents.
+/* Tries to decode an entire frame.
  *
  * The current state in *av is used to try run ffmpeg's decoder.
  *
- * If successful, returns E_OK and sets 'buf' and 'n' to a pointer to the buffer
- * and number of bytes decoded into it respectively.
+ * If successful, returns E_OK and sets 'n' to the number of samples decoded;
+ * use audio_av_convert to get at them.
  *
  * If the return value is E_EOF, we have run out of frames to decode; any other
- * return value signifies a decode error.  Do NOT rely on 'buf' and 'n' having
- * sensible values if E_OK is not returned.
+ * return value signifies a decode error.  Do NOT rely on 'n' having a sensible
+ * value if E_OK is not returned.
  */
 enum error
-audio_av_decode(struct au_in *av, char **buf, size_t *n)
+audio_av_decode(struct au_in *av, size_t *n)
 {
 	enum error	err = E_INCOMPLETE;
 
@@ -269,81 +395,72 @@ audio_av_decode(struct au_in *av, char **buf, size_t *n)
 		if (av_read_frame(av->context, av->packet) < 0) {
 			err = E_EOF;
 		}
+		/* The resampler holds back a few samples' worth of filter
+		 * history, which we need to get out of it at the end.
+		 */
+		if (err == E_EOF && av->rs != NULL && !av->flushed) {
+			av->flushed = true;
+			err = resample(av, NULL, n);
+			if (err == E_INCOMPLETE)
+				err = E_EOF;
+		}
 		if (err == E_INCOMPLETE &&
 		    av->packet->stream_index == av->stream_id) {
-			err = decode_packet(av, buf, n);
+			err = decode_packet(av, n);
 		}
+		if (err == E_OK)
+			err = trim(av, n);
 	}
 
 	return err;
 }
 
-/**  STATIC FUNCTIONS  ********************************************************/
-
-/* Converts from ffmpeg sample format to PortAudio sample format.
+/* Converts 'n' samples, starting 'offset' samples into the last decoded frame,
+ * into interleaved samples in the output format at 'dst'.
  *
- * The conversion is currently done straight with no attempts to
- * convert disallowed sample formats, and as such may fail with more
- * esoteric ffmpeg sample formats.
+ * 'dst' must have room for audio_av_samples2bytes(av, n) bytes.
  */
-static enum error
-conv_sample_fmt(enum AVSampleFormat in, PaSampleFormat *out)
+void
+audio_av_convert(struct au_in *av, char *dst, size_t offset, size_t n)
 {
-	enum error	err = E_OK;
-
-	switch (in) {
-	case AV_SAMPLE_FMT_U8:
-		*out = paUInt8;
-		break;
-	case AV_SAMPLE_FMT_S16:
-		*out = paInt16;
-		break;
-	case AV_SAMPLE_FMT_S32:
-		*out = paInt32;
-		break;
-	case AV_SAMPLE_FMT_FLT:
-		*out = paFloat32;
-		break;
-	default:
-		err = error(E_BAD_FILE, "unusable sample rate");
-	}
-
-	return err;
+	audio_conv_run(av->conv, dst, av->data, av->skip + offset, n);
 }
 
-/* Sets up a PortAudio parameter set ready for ffmpeg frames to be thrown at it.
- *
- * The parameter set pointed to by *params MUST already be allocated, and its
- * contents should only be used if this function returns E_OK.
- */
+/**  STATIC FUNCTIONS  ********************************************************/
+
 static enum error
-setup_pa(PaSampleFormat sf, int device, int chans, PaStreamParameters *pars)
+au_load_file(struct au_in *av, const char *path, const volatile bool *cancel)
 {
-	enum error	err = E_OK;	/* Nothing can go wrong atm. */
-
-	memset(pars, 0, sizeof(*pars));
-	pars->channelCount = chans;
-	pars->device = device;
-	pars->hostApiSpecificStreamInfo = NULL;
-	pars->sampleFormat = sf;
-	pars->suggestedLatency = (Pa_GetDeviceInfo(device)->
-				  defaultLowOutputLatency);
+	enum error	err = E_OK;
 
+	av->context = avformat_alloc_context();
+	if (av->context == NULL)
+		err = error(E_NO_MEM, "couldn't alloc format context");
+	/* Opening and probing can block for ages on slow storage, so let
+	 * whoever is loading us pull the plug.
+	 */
+	if (err == E_OK && cancel != NULL) {
+		av->context->interrupt_callback.callback = load_cancelled;
+		av->context->interrupt_callback.opaque = (void *)cancel;
+	}
+	/* avformat_open_input frees the context if it fails */
+	if (err == E_OK && avformat_open_input(&(av->context),
+					       path,
+					       NULL,
+					       NULL) < 0) {
+		if (cancel != NULL && *cancel)
+			err = E_INCOMPLETE;
+		else
+			err = error(E_NO_FILE, "couldn't open %s", path);
+	}
 	return err;
 }
 
-static enum error
-au_load_file(struct au_in *av, const char *path)
+/* Tells ffmpeg whether the load it's doing has been cancelled. */
+static int
+load_cancelled(void *v_cancel)
 {
-	enum error	err = E_OK;
-
-	if (avformat_open_input(&(av->context),
-				path,
-				NULL,
-				NULL) < 0)
-		err = error(E_NO_FILE, "couldn't open %s", path);
-
-	return err;
+	return (int)*(const volatile bool *)v_cancel;
 }
 
 static enum error
@@ -415,6 +532,29 @@ au_init_packet(AVPacket **packet, uint8_t *buffer)
 	return err;
 }
 
+/* Sets up the path from decoded frames to converted samples.
+ *
+ * If the file's sample rate isn't the output's, the frames go through the
+ * resampler first, and 'conv' converts from what that produces instead.
+ */
+static enum error
+au_init_conv(struct au_in *av)
+{
+	int		rate = av->stream->codec->sample_rate;
+	int		chans = av->stream->codec->channels;
+	enum AVSampleFormat fmt = av->stream->codec->sample_fmt;
+	enum error	err = E_OK;
+
+	if ((double)rate != av->out_rate) {
+		err = audio_rs_init(&(av->rs), fmt, chans, rate,
+				    (int)av->out_rate);
+		fmt = AUDIO_RS_FMT;
+	}
+	if (err == E_OK)
+		err = audio_conv_init(&(av->conv), fmt, chans,
+				      av->out_fmt, av->out_chans);
+	return err;
+}
 
 /*----------------------------------------------------------------------------
  *  Decoding a frame
@@ -423,11 +563,15 @@ au_init_packet(AVPacket **packet, uint8_t *buffer)
 /*  Also see the non-static functions for the frontend for frame decoding */
 
 static enum error
-decode_packet(struct au_in *av, char **buf, size_t *n)
+decode_packet(struct au_in *av, size_t *n)
 {
 	enum error	err = E_OK;
 	int		frame_finished = 0;
 
+#ifdef HAVE_SKIP_SIDE_DATA
+	/* We trim the delay and padding ourselves (see trim) */
+	take_skip(av, (size_t)av->stream->codec->frame_size);
+#endif /* HAVE_SKIP_SIDE_DATA */
 	if (avcodec_decode_audio4(av->stream->codec,
 				  av->frame,
 				  &frame_finished,
@@ -440,8 +584,32 @@ decode_packet(struct au_in *av, char **buf, size_t *n)
 		err = E_INCOMPLETE;
 	if (err == E_OK) {
 		/* Record data that we'll use in the play loop */
-		*buf = (char *)av->frame->extended_data[0];
+		av->data = av->frame->extended_data;
 		*n = av->frame->nb_samples;
+		sync_position(av);
+	}
+	if (err == E_OK && av->rs != NULL)
+		err = resample(av, av->data, n);
+	return err;
+}
+
+/* Pushes the '*n' samples in 'in' through the resampler, pointing the
+ * converter at the results and setting '*n' to how many there are.
+ *
+ * 'in' may be NULL to drain the resampler at the end of the file.  Returns
+ * E_INCOMPLETE if the resampler didn't have anything to give back yet.
+ */
+static enum error
+resample(struct au_in *av, uint8_t *const *in, size_t *n)
+{
+	uint8_t       **out;
+	enum error	err = E_OK;
+
+	err = audio_rs_run(av->rs, in, (in == NULL ? 0 : *n), &out, n);
+	if (err == E_OK) {
+		av->data = out;
+		if (*n == 0)
+			err = E_INCOMPLETE;
 	}
 	return err;
 }
@@ -457,3 +625,195 @@ static void avcodec_free_frame(AVFrame **frame)
 	*frame = NULL;
 }
 #endif /* MOCK_AVCODEC_FREE_FRAME */
+
+/*----------------------------------------------------------------------------
+ *  Position tracking
+ *----------------------------------------------------------------------------*/
+
+/* Tries to seek to just before 'seek_pos' (in the stream's time base) using
+ * the seek index, which goes straight to the right byte of the file instead of
+ * leaving the demuxer to scan or estimate.
+ *
+ * We start INDEX_PREROLL_USECS early, as some codecs (MP3, for one) need a
+ * frame or two of history to decode properly; the extra is thrown away.
+ * Packet timestamps after a byte seek can't always be trusted, so the
+ * position is taken from the index instead.
+ *
+ * Returns false, having done nothing, if the index can't help.
+ */
+static bool
+index_seek(struct au_in *av, int64_t seek_pos)
+{
+	int64_t		pos;
+	int64_t		ts;
+	bool		ok;
+
+	seek_pos -= av_rescale_q((int64_t)INDEX_PREROLL_USECS,
+				 AV_TIME_BASE_Q,
+				 av->stream->time_base);
+	ok = audio_index_find(av->index, seek_pos, &pos, &ts);
+	if (ok)
+		ok = av_seek_frame(av->context,
+				   av->stream_id,
+				   pos,
+				   AVSEEK_FLAG_BYTE) >= 0;
+	if (ok) {
+		av->next = ts2samples(av, ts);
+		av->resync = false;
+	}
+	return ok;
+}
+
+/* If we've lost track of where we are (at the start, or after a seek), picks
+ * it back up from the timestamp of the frame just decoded.
+ *
+ * Otherwise the position just runs on from the samples handed out, which is
+ * both cheaper and immune to the odd wonky timestamp.  The resampler means
+ * frames and handed-out samples don't line up one-to-one, but as it is reset
+ * whenever we resync, and drops its filter's lead-in after a reset, the first
+ * sample into it is the first one out.
+ */
+static void
+sync_position(struct au_in *av)
+{
+	int64_t		ts = av->frame->best_effort_timestamp;
+
+	if (av->resync && ts != AV_NOPTS_VALUE)
+		av->next = ts2samples(av, ts);
+	av->resync = false;
+}
+
+/* Converts a timestamp in the stream's time base to a position in samples. */
+static uint64_t
+ts2samples(struct au_in *av, int64_t ts)
+{
+	if (av->stream->start_time != AV_NOPTS_VALUE)
+		ts -= av->stream->start_time;
+	ts = av_rescale_q(ts,
+			  av->stream->time_base,
+			  (AVRational){1, (int)av->out_rate});
+	return (ts < 0 ? 0 : (uint64_t)ts);
+}
+
+/* Works out where the '*n' samples just produced lie in the file, and throws
+ * away any of them that are encoder delay or padding rather than real audio,
+ * or that come before the seek target if we are seeking.
+ *
+ * Nothing is copied; the samples kept are picked out with 'skip' and '*n'.
+ * Returns E_INCOMPLETE if all of them were thrown away, so that the caller
+ * goes back for more, and E_EOF if we're into the padding at the end.
+ */
+static enum error
+trim(struct au_in *av, size_t *n)
+{
+	uint64_t	start = av->next;
+	uint64_t	first = av->delay;
+	uint64_t	last = UINT64_MAX;
+	enum error	err = E_OK;
+
+	if (av->seeking)
+		first += av->target;
+	if (av->length != UINT64_MAX)
+		last = av->delay + av->length;
+
+	av->skip = 0;
+	av->next = start + *n;
+	if (av->next <= first)
+		err = E_INCOMPLETE;
+	else if (start >= last)
+		err = E_EOF;
+	if (err == E_OK) {
+		if (start < first)
+			av->skip = (size_t)(first - start);
+		if (av->next > last)
+			*n -= (size_t)(av->next - last);
+		*n -= av->skip;
+		av->pos = start + av->skip - av->delay;
+		av->seeking = false;
+	}
+	return err;
+}
+
+/*----------------------------------------------------------------------------
+ *  Encoder delay and padding
+ *----------------------------------------------------------------------------*/
+
+/* Looks for encoder delay and padding that the file declares up front.
+ *
+ * Of the places this can be declared, only iTunes' iTunSMPB tag (used by AAC
+ * files) needs looking for here; the others, such as the LAME tag in MP3s,
+ * are read by ffmpeg and come through as packet side data (see take_skip).
+ */
+static void
+au_init_trim(struct au_in *av)
+{
+	AVDictionaryEntry *tag = NULL;
+	unsigned int	zero;
+	unsigned int	delay;
+	unsigned int	padding;
+	uint64_t	length;
+
+	av->delay = 0;
+	av->length = UINT64_MAX;
+#ifdef HAVE_ITUNSMPB
+	tag = av_dict_get(av->stream->metadata, "iTunSMPB", NULL, 0);
+	if (tag == NULL)
+		tag = av_dict_get(av->context->metadata, "iTunSMPB", NULL, 0);
+#endif /* HAVE_ITUNSMPB */
+	/* " 00000000 00000840 000001CC 0000000000A5A3F4 ..." */
+	if (tag != NULL && sscanf(tag->value, "%x %x %x %" SCNx64,
+				  &zero, &delay, &padding, &length) == 4) {
+		av->delay = file2out(av, delay);
+		if (length > 0)
+			av->length = file2out(av, length);
+		dbug("iTunSMPB: delay %u, padding %u", delay, padding);
+	}
+}
+
+#ifdef HAVE_SKIP_SIDE_DATA
+/* Takes any encoder delay or padding attached to the packet about to be
+ * decoded (ffmpeg puts it there when it finds a LAME tag, for one).
+ *
+ * The side data is zeroed afterwards, so that the decoder doesn't trim the
+ * samples as well; trimming them in trim keeps the position tracking honest,
+ * and works the same whichever way the delay was declared.  'frame_samples'
+ * is the number of samples the packet will decode to, if known.
+ */
+static void
+take_skip(struct au_in *av, size_t frame_samples)
+{
+	uint8_t        *side;
+	int		size = 0;
+	uint32_t	padding;
+
+	side = av_packet_get_side_data(av->packet,
+				       AV_PKT_DATA_SKIP_SAMPLES,
+				       &size);
+	if (side != NULL && size >= 4 && AV_RL32(side) > 0) {
+		av->delay = file2out(av, AV_RL32(side));
+		AV_WL32(side, 0);
+	}
+	/* The padding is counted back from the end of this packet */
+	if (side != NULL && size >= 8 && AV_RL32(side + 4) > 0) {
+		padding = AV_RL32(side + 4);
+		if (frame_samples > padding && !av->resync &&
+		    av->next >= av->delay)
+			av->length = (av->next - av->delay +
+				      file2out(av, frame_samples - padding));
+		AV_WL32(side + 4, 0);
+	}
+}
+#endif /* HAVE_SKIP_SIDE_DATA */
+
+/* Converts a sample count at the file's sample rate to one at out_rate. */
+static uint64_t
+file2out(struct au_in *av, uint64_t samples)
+{
+	int		rate = av->stream->codec->sample_rate;
+
+	if (rate > 0 && rate != (int)av->out_rate)
+		samples = (uint64_t)av_rescale((int64_t)samples,
+					       (int64_t)av->out_rate,
+					       (int64_t)rate);
+	return samples;
+}
@@ -40,10 +40,10 @@
 
 /**  INCLUDES  ****************************************************************/
 
+#include <stdbool.h>		/* bool */
 #include <stdint.h>		/* uint64_t */
 
 #include <libavformat/avformat.h>
-#include <portaudio.h>		/* PaStreamParameters */
 
 #include "cuppa/errors.h"	/* enum error */
 
@@ -69,24 +69,32 @@ struct au_frame;
 
 /* Attempts to set ffmpeg up for reading the file in 'path', placing
  * the resulting au_in structure pointer in the location pointed to by
- * 'av'.
- */
-enum error	audio_av_load(struct au_in **av, const char *path);
-void		audio_av_unload(struct au_in *av);
-
-/* Populates the given PortAudio parameter variables with information
- * from the ffmpeg audio context.
+ * 'av'.  Decoded samples will be converted to sample format 'fmt', with
+ * 'chans' channels, at 'rate' Hz.
  *
- * The parameter variables MUST already have been allocated.
+ * If 'seekable' is true, the file's seek index is opened too (see
+ * audio_index.h), to make seeking quicker; this may start building the index
+ * in the background, so files that are never seeked in should do without.
+ *
+ * If 'cancel' isn't NULL, opening the file is abandoned, with E_INCOMPLETE,
+ * once *cancel becomes true.
  */
 enum error
-audio_av_pa_config(struct au_in *av,	/* ffmpeg audio structure */
-		   int device,	/* PortAudio device */
-		   PaStreamParameters *params,
-		   size_t *samples_per_buf);
+audio_av_load(struct au_in **av,
+	      const char *path,
+	      enum AVSampleFormat fmt,
+	      int chans,
+	      double rate,
+	      bool seekable,
+	      const volatile bool *cancel);
+void		audio_av_unload(struct au_in *av);
 
-enum error	audio_av_decode(struct au_in *av, char **buf, size_t *n);
+enum error	audio_av_decode(struct au_in *av, size_t *n);
+void		audio_av_convert(struct au_in *av, char *dst,
+				 size_t offset, size_t n);
 double		audio_av_sample_rate(struct au_in *av);
+uint64_t	audio_av_position(struct au_in *av);
+uint64_t	audio_av_length(struct au_in *av);
 
 enum error	audio_av_seek(struct au_in *av, uint64_t usec);
 
@@ -37,7 +37,7 @@
 
 /**  INCLUDES  ****************************************************************/
 
-#include <string.h>
+#include <stdbool.h>		/* bool */
 
 #include <portaudio.h>
 
@@ -45,88 +45,207 @@
 #include "contrib/pa_ringbuffer.h"	/* Ringbuffer */
 
 #include "audio.h"		/* Manipulating the audio structure */
+#include "audio_cb.h"
+#include "audio_out.h"		/* Finding the audio structure */
+#include "counters.h"		/* counters_xyz */
+#include "event.h"		/* event_post */
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static int	fill(struct au_out *ao, char *out, unsigned long frames_per_buf);
+static unsigned long read_frames(struct audio *au, char *out,
+				 unsigned long frames, float gain);
+static struct audio *follow_on(struct au_out *ao, struct audio *au, char *out,
+			       unsigned long frames, unsigned long *written);
 
 /**  PUBLIC FUNCTIONS  ********************************************************/
 
-/* The callback proper, which is executed in a separate thread by PortAudio once
- * a stream is playing with the callback registered to it.
+/* The mixing function for a deck's source (struct au_out) in its device's
+ * mixer, which is run in the sink's callback thread (see mixer.c).
+ *
+ * Sources that run out for good, or fail, are halted, and the main loop told
+ * so that it can deal with them.
  */
-int
-audio_cb_play(const void *in,
-	      void *out,
-	      unsigned long frames_per_buf,
-	      const PaStreamCallbackTimeInfo *timeInfo,
-	      PaStreamCallbackFlags statusFlags,
-	      void *v_au)
+void
+audio_cb_mix(void *v_ao, char *out, unsigned long frames)
 {
-	unsigned long	avail;
-	PaStreamCallbackResult result = paContinue;
-	struct audio   *au = (struct audio *)v_au;
-	char           *cout = (char *)out;
-	unsigned long	frames_written = 0;
-	PaUtilRingBuffer *buffer = audio_ringbuf(au);
+	int		result;
+	uint64_t	start;
+	struct au_out  *ao = (struct au_out *)v_ao;
+
+	if (audio_out_running(ao)) {
+		start = counters_nsecs();
+		result = fill(ao, out, frames);
+		counters_run(audio_out_play_counters(ao),
+			     counters_nsecs() - start);
+		if (result != paContinue) {
+			audio_out_halt(ao);
+			event_post();
+		}
+	}
+}
 
-	/* Ignoring these arguments */
-	in = (const void *)in;
-	timeInfo = (const void *)timeInfo;
-	statusFlags = (int)statusFlags;
+/* The readiness check for a deck's source: it's ready if it has enough
+ * decoded to fill the next 'frames' samples, or if there's no point waiting
+ * because it isn't playing or its decoder has stopped for good.
+ *
+ * While paused, the decoder fills the ring up anyway, so waiting is fine.
+ */
+bool
+audio_cb_ready(void *v_ao, unsigned long frames)
+{
+	ring_buffer_size_t avail;
+	enum error	err;
+	struct au_out  *ao = (struct au_out *)v_ao;
+	struct audio   *au = audio_out_attached(ao);
+	bool		ready = true;
+
+	if (au != NULL && audio_out_running(ao)) {
+		err = audio_error(au);
+		avail = PaUtil_GetRingBufferReadAvailable(audio_ringbuf(au));
+		if (err == E_OK || err == E_INCOMPLETE)
+			ready = ((unsigned long)avail >= frames);
+	}
+	return ready;
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* Adds 'frames_per_buf' samples from the audio attached to source 'ao' into
+ * the mix at 'out'.  Silence (while paused, or on running out) is just left
+ * out of the mix.
+ *
+ * Returns paContinue normally, or paComplete or paAbort once the source
+ * should stop playing, having run out of audio or hit an error respectively.
+ */
+static int
+fill(struct au_out *ao, char *out, unsigned long frames_per_buf)
+{
+	unsigned long	frames_written = 0;
+	ring_buffer_size_t avail;
+	bool		resumed;
+	PaStreamCallbackResult result = paContinue;
+	struct audio   *au = audio_out_attached(ao);
+	struct play_counters *counters = audio_out_play_counters(ao);
+	char           *cout = out;
 
-	while (result == paContinue && frames_written < frames_per_buf) {
-		avail = PaUtil_GetRingBufferReadAvailable(buffer);
-		if (avail == 0) {
+	/* If there's been a seek, skip to it before reading; this happens
+	 * while paused too, so the seek is done by the time we resume.
+	 */
+	if (au != NULL)
+		audio_take_seek(au);
+	/* While paused, add nothing, leaving the ring alone */
+	if (au != NULL && !audio_out_playing(ao, &resumed))
+		au = NULL;
+	if (au != NULL) {
+		if (resumed)
+			audio_start_fade(au);
+		avail = PaUtil_GetRingBufferReadAvailable(audio_ringbuf(au));
+		counters_fill(counters, (uint64_t)avail);
+		frames_written = read_frames(au, cout, frames_per_buf,
+					     audio_out_gain(ao));
+	}
+	if (au != NULL && frames_written < frames_per_buf) {
+		/*
+		 * We've run out of sound, ruh-roh. Let's see if something
+		 * went awry during the last decode cycle...
+		 */
+		switch (audio_error(au)) {
+		case E_EOF:
 			/*
-			 * We've run out of sound, ruh-roh. Let's see if
-			 * something went awry during the last decode
-			 * cycle...
+			 * We've just hit the end of the file.  If there's
+			 * something cued up, carry straight on into it;
+			 * otherwise, nothing to worry about!
 			 */
-			switch (audio_error(au)) {
-			case E_EOF:
-				/*
-				 * We've just hit the end of the file.
-				 * Nothing to worry about!
-				 */
+			au = follow_on(ao, au, cout,
+				       frames_per_buf, &frames_written);
+			if (au == NULL)
 				result = paComplete;
-				break;
-			case E_OK:
-			case E_INCOMPLETE:
-				/*
-				 * Looks like we're just waiting for the
-				 * decoding to go through. In other words,
-				 * this is a buffer underflow.
-				 */
-				dbug("buffer underflow");
-				/* Break out of the loop inelegantly */
-				memset(cout,
-				       0,
-				       audio_samples2bytes(au,
-							   frames_per_buf)
-					);
-				frames_written = frames_per_buf;
-				break;
-			default:
-				/* Something genuinely went tits-up. */
-				result = paAbort;
-				break;
-			}
-		} else {
-			unsigned long	samples;
-
-			/* How many samples do we have? */
-			if (avail > frames_per_buf - frames_written)
-				samples = frames_per_buf - frames_written;
-			else
-				samples = avail;
-
+			break;
+		case E_OK:
+		case E_INCOMPLETE:
 			/*
-			 * TODO: handle the ulong->long cast more gracefully,
-			 * perhaps.
+			 * Looks like we're just waiting for the decoding to
+			 * go through. In other words, this is a buffer
+			 * underflow.
 			 */
-			cout += PaUtil_ReadRingBuffer(buffer,
-						      cout,
-					       (ring_buffer_size_t)samples);
-			frames_written += samples;
-			audio_inc_used_samples(au, samples);
+			dbug("buffer underflow");
+			counters->underruns++;
+			counters->lost += frames_per_buf - frames_written;
+			break;
+		default:
+			/* Something genuinely went tits-up. */
+			result = paAbort;
+			break;
 		}
 	}
+	if (au != NULL)
+		audio_check_low_water(au);
 	return (int)result;
 }
+
+/* Carries on from audio 'au', which has reached the end of its file, into
+ * whatever has been cued up after it, filling the rest of the 'frames' samples
+ * at 'out' (of which '*written' have been filled so far).
+ *
+ * Returns the audio that is now attached, which may still be 'au' if it turns
+ * out not to be finished after all, or NULL if nothing is cued and playback
+ * should end.  The old audio MUST NOT be touched
+ * again once this returns anything else, as the main loop may free it.
+ */
+static struct audio *
+follow_on(struct au_out *ao, struct audio *au, char *out,
+	  unsigned long frames, unsigned long *written)
+{
+	struct audio   *next = au;
+
+	/* The decoder may have written the last of the file since we read */
+	*written += read_frames(au, out + audio_out_samples2bytes(ao, *written),
+				frames - *written, audio_out_gain(ao));
+	if (*written < frames)
+		next = audio_out_hand_over(ao);
+	if (next != NULL && next != au) {
+		/* The cued audio has been filling its ring since it was
+		 * loaded, so there's no waiting around here.
+		 */
+		*written += read_frames(next,
+					out + audio_out_samples2bytes(ao,
+								      *written),
+					frames - *written, audio_out_gain(ao));
+		event_post();
+	}
+	return next;
+}
+
+/* Adds up to 'frames' samples from the ring buffer, at 'gain', into the mix
+ * at 'out', returning the number of samples added.
+ *
+ * The samples are summed straight out of the ring's memory (which may be split
+ * in two where it wraps around), so this is the only copy on the way out.
+ */
+static unsigned long
+read_frames(struct audio *au, char *out, unsigned long frames, float gain)
+{
+	void           *r1;
+	void           *r2;
+	ring_buffer_size_t n1;
+	ring_buffer_size_t n2;
+	size_t		bytes1;
+	PaUtilRingBuffer *buffer = audio_ringbuf(au);
+
+	/*
+	 * TODO: handle the ulong->long cast more gracefully, perhaps.
+	 */
+	PaUtil_GetRingBufferReadRegions(buffer,
+					(ring_buffer_size_t)frames,
+					&r1, &n1, &r2, &n2);
+	bytes1 = audio_samples2bytes(au, (size_t)n1);
+	audio_sum_out(au, out, (const char *)r1, (size_t)n1, gain);
+	if (n2 > 0)
+		audio_sum_out(au, out + bytes1, (const char *)r2, (size_t)n2,
+			      gain);
+	PaUtil_AdvanceRingBufferReadIndex(buffer, n1 + n2);
+
+	audio_inc_used_samples(au, (uint64_t)(n1 + n2));
+	return (unsigned long)(n1 + n2);
+}
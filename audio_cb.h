@@ -39,18 +39,12 @@
 
 /**  INCLUDES  ****************************************************************/
 
-#include <stdint.h>		/* uint64_t */
-
-#include "contrib/pa_ringbuffer.h"	/* PaUtilRingBuffer */
+#include <stdbool.h>		/* bool */
 
 /**  FUNCTIONS  ***************************************************************/
 
-int
-audio_cb_play(const void *in,
-	      void *out,
-	      unsigned long frames_per_buf,
-	      const PaStreamCallbackTimeInfo *timeInfo,
-	      PaStreamCallbackFlags statusFlags,
-	      void *v_au);
+/* Mixing and readiness functions for struct au_out sources (see mixer.h) */
+void		audio_cb_mix(void *v_ao, char *out, unsigned long frames);
+bool		audio_cb_ready(void *v_ao, unsigned long frames);
 
 #endif				/* not AUDIO_CB_H */
@@ -0,0 +1,1034 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  audio_conv.c
+ *
+ *    Description:  Sample format conversion kernels
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <math.h>		/* cosf, sinf */
+#include <stdint.h>
+#include <stdlib.h>		/* calloc, free */
+#include <string.h>		/* memcpy */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <libavutil/samplefmt.h>
+#include <libavutil/version.h>	/* For newer sample formats */
+
+#include "cuppa/errors.h"	/* error */
+
+#include "audio_conv.h"
+
+/**  MACROS  ******************************************************************/
+
+/* Number of samples per channel converted in one go by the two-stage
+ * (to float, then to output) conversion.  Small enough for the scratch space
+ * to stay in cache.
+ */
+#define CHUNK 256
+
+/* Most channels that can be converted to (the output stream has at most
+ * OUT_CHANNELS, but this is a hard limit on the channel map).
+ */
+#define MAX_CHANNELS 8
+
+/* M_PI_2 is an XSI extension */
+#define HALF_PI 1.57079632679489661923f
+
+/* Sample formats with 64-bit integers only appeared in later libavutils. */
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(55, 31, 100)
+#define HAVE_S64
+#endif
+
+/**  TYPEDEFS  ****************************************************************/
+
+/* A single-pass kernel that needs no scratch space or state.
+ *
+ * These take 'n' samples, starting 'offset' samples in, from 'src' and write
+ * them, interleaved, to 'dst'.
+ */
+typedef void	(*direct_fn) (char *dst,
+			      uint8_t *const *src,
+			      size_t offset,
+			      size_t n,
+			      int chans);
+
+/* A kernel that converts 'n' contiguous samples of some format at 'src' into
+ * normalised (-1 to 1) floats at 'dst'.
+ */
+typedef void	(*to_flt_fn) (float *dst, const uint8_t *src, size_t n);
+
+/**  DATA TYPES  **************************************************************/
+
+struct au_conv {
+	enum AVSampleFormat in;	/* Format of decoded frames */
+	enum AVSampleFormat out;	/* Format of converted samples */
+	int		in_chans;	/* Number of channels in frames */
+	int		chans;	/* Number of channels converted to */
+	int		map[MAX_CHANNELS];	/* Input channel for each output */
+	size_t		in_bps;	/* Bytes per input sample */
+	int		planar;	/* Is 'in' a planar format? */
+	direct_fn	direct;	/* If not NULL, does the whole conversion */
+	to_flt_fn	to_flt;	/* Otherwise, first stage of conversion */
+	float          *wide;	/* Packed input floats, CHUNK * in_chans */
+	float          *mixed;	/* Interleaved floats, CHUNK * chans */
+	float          *plane[2];	/* Single-channel floats, CHUNK each */
+	uint32_t	rng[4];	/* Dither noise state, one per vector lane */
+};
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static direct_fn pick_direct(enum AVSampleFormat in, int chans,
+			     enum AVSampleFormat out);
+static to_flt_fn pick_to_flt(enum AVSampleFormat in);
+static void	run_chunk(struct au_conv *cv, char *dst, uint8_t *const *src,
+			  size_t offset, size_t n);
+static void	scatter(float *dst, const float *src, size_t n, int stride);
+static void	remap(struct au_conv *cv, float *dst, const float *src,
+		      size_t n);
+static void	fade_gains(enum xfade_curve curve, size_t pos, size_t len,
+			   size_t n, int chans, float *out, float *in);
+static void	mix_flt(float *dst, const float *src, const float *out,
+			const float *in, size_t n);
+static void	mix_s16(int16_t *dst, const int16_t *src, const float *out,
+			const float *in, size_t n);
+static void	sum_flt(float *dst, const float *src, float gain, size_t n);
+static void	sum_s16(int16_t *dst, const int16_t *src, float gain,
+			size_t n);
+static void	flt_to_s16(struct au_conv *cv, int16_t *dst, const float *src,
+			   size_t n);
+
+static void	copy_packed16(char *dst, uint8_t *const *src, size_t offset,
+			      size_t n, int chans);
+static void	copy_packed32(char *dst, uint8_t *const *src, size_t offset,
+			      size_t n, int chans);
+static void	interleave16(char *dst, uint8_t *const *src, size_t offset,
+			     size_t n, int chans);
+static void	interleave32(char *dst, uint8_t *const *src, size_t offset,
+			     size_t n, int chans);
+static void	interleave16_stereo(char *dst, uint8_t *const *src,
+				    size_t offset, size_t n, int chans);
+static void	interleave32_stereo(char *dst, uint8_t *const *src,
+				    size_t offset, size_t n, int chans);
+
+static void	u8_to_flt(float *dst, const uint8_t *src, size_t n);
+static void	s16_to_flt(float *dst, const uint8_t *src, size_t n);
+static void	s32_to_flt(float *dst, const uint8_t *src, size_t n);
+static void	flt_to_flt(float *dst, const uint8_t *src, size_t n);
+static void	dbl_to_flt(float *dst, const uint8_t *src, size_t n);
+#ifdef HAVE_S64
+static void	s64_to_flt(float *dst, const uint8_t *src, size_t n);
+#endif				/* HAVE_S64 */
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+/* The output format is fixed for the life of the program, so every input
+ * format needs a way of getting to it.
+ *
+ * Where the output is just a rearrangement of the input (packed to packed of
+ * the same format, or planar to its packed equivalent), a single-pass 'direct'
+ * kernel does the job.  Everything else goes via normalised floats in scratch
+ * space: a 'to_flt' kernel for the input format, then interleaving if the
+ * input is planar, then (for S16 output) dithered quantisation.
+ *
+ * The output channel count is fixed too.  Missing channels repeat the last
+ * input channel (so mono plays on both sides of a stereo output) and extra
+ * input channels are dropped (so 5.1 plays its front left and right).
+ *
+ * Kernels are vectorised where the compiler has been told the target has SSE2
+ * or AVX2 (which, on amd64, it always has SSE2).  There is no portable way to
+ * ask the CPU at run time, so pass -mavx2 or similar in ARCHFLAGS to get the
+ * wider kernels.
+ */
+enum error
+audio_conv_init(struct au_conv **cv,
+		enum AVSampleFormat in,
+		int in_chans,
+		enum AVSampleFormat out,
+		int chans)
+{
+	int		c;
+	enum error	err = E_OK;
+
+	err = audio_conv_out_ok(out);
+	if (err == E_OK && in_chans < 1)
+		err = error(E_BAD_FILE, "no channels to convert");
+	if (err == E_OK && (chans < 1 || chans > MAX_CHANNELS))
+		err = error(E_BAD_CONFIG, "can't convert to %d channels", chans);
+	if (err == E_OK) {
+		*cv = calloc((size_t)1, sizeof(struct au_conv));
+		if (*cv == NULL)
+			err = error(E_NO_MEM, "can't alloc conversion structure");
+	}
+	if (err == E_OK) {
+		(*cv)->in = in;
+		(*cv)->out = out;
+		(*cv)->in_chans = in_chans;
+		(*cv)->chans = chans;
+		for (c = 0; c < chans; c++)
+			(*cv)->map[c] = (c < in_chans ? c : in_chans - 1);
+		(*cv)->in_bps = (size_t)av_get_bytes_per_sample(in);
+		(*cv)->planar = av_sample_fmt_is_planar(in);
+		if (in_chans == chans)
+			(*cv)->direct = pick_direct(in, chans, out);
+		(*cv)->to_flt = pick_to_flt(in);
+
+		/* Any non-zero seeds will do for xorshift */
+		(*cv)->rng[0] = 0x9e3779b9;
+		(*cv)->rng[1] = 0x7f4a7c15;
+		(*cv)->rng[2] = 0x85ebca6b;
+		(*cv)->rng[3] = 0xc2b2ae35;
+
+		if ((*cv)->direct == NULL && (*cv)->to_flt == NULL)
+			err = error(E_BAD_FILE, "unusable sample format");
+	}
+	if (err == E_OK && (*cv)->direct == NULL) {
+		(*cv)->wide = calloc((size_t)CHUNK * (size_t)in_chans,
+				     sizeof(float));
+		(*cv)->mixed = calloc((size_t)CHUNK * (size_t)chans,
+				      sizeof(float));
+		(*cv)->plane[0] = calloc((size_t)CHUNK, sizeof(float));
+		(*cv)->plane[1] = calloc((size_t)CHUNK, sizeof(float));
+		if ((*cv)->wide == NULL || (*cv)->mixed == NULL ||
+		    (*cv)->plane[0] == NULL || (*cv)->plane[1] == NULL)
+			err = error(E_NO_MEM, "can't alloc conversion scratch");
+	}
+	if (err == E_OK)
+		dbug("converting %d-channel %s to %d-channel %s (%s)",
+		     in_chans, av_get_sample_fmt_name(in),
+		     chans, av_get_sample_fmt_name(out),
+		     (*cv)->direct == NULL ? "via float" : "direct");
+
+	return err;
+}
+
+void
+audio_conv_free(struct au_conv *cv)
+{
+	if (cv != NULL) {
+		free(cv->wide);
+		free(cv->mixed);
+		free(cv->plane[0]);
+		free(cv->plane[1]);
+		free(cv);
+	}
+}
+
+void
+audio_conv_run(struct au_conv *cv,
+	       char *dst,
+	       uint8_t *const *src,
+	       size_t offset,
+	       size_t n)
+{
+	size_t		done;
+	size_t		count;
+	size_t		out_frame;
+
+	if (cv->direct != NULL)
+		cv->direct(dst, src, offset, n, cv->chans);
+	else {
+		out_frame = (size_t)av_get_bytes_per_sample(cv->out) *
+			(size_t)cv->chans;
+		for (done = 0; done < n; done += count) {
+			count = (n - done < CHUNK ? n - done : CHUNK);
+			run_chunk(cv, dst + (done * out_frame), src,
+				  offset + done, count);
+		}
+	}
+}
+
+/* This is only used for short fades, so it isn't worth vectorising; each
+ * sample goes through the summing kernels on its own, at its own gain.
+ */
+void
+audio_conv_sum_ramp(enum AVSampleFormat fmt,
+		    int chans,
+		    char *dst,
+		    const char *src,
+		    size_t n,
+		    float gain,
+		    size_t pos,
+		    size_t len)
+{
+	size_t		i;
+	size_t		at;
+	float		g;
+
+	for (i = 0; i < n; i++) {
+		g = gain * ((float)(pos + i) / (float)len);
+		at = i * (size_t)chans;
+		if (fmt == AV_SAMPLE_FMT_FLT)
+			sum_flt((float *)dst + at, (const float *)src + at,
+				g, (size_t)chans);
+		else
+			sum_s16((int16_t *)dst + at, (const int16_t *)src + at,
+				g, (size_t)chans);
+	}
+}
+
+/* The gains for each sample are worked out a chunk at a time, so that the
+ * mixing itself is a straight run over interleaved samples that vectorises.
+ */
+void
+audio_conv_mix(enum AVSampleFormat fmt,
+	       int chans,
+	       char *dst,
+	       const char *src,
+	       size_t n,
+	       size_t pos,
+	       size_t len,
+	       enum xfade_curve curve)
+{
+	size_t		frames;
+	size_t		samples;
+	size_t		done = 0;
+	size_t		bytes = (size_t)av_get_bytes_per_sample(fmt);
+	float		out[CHUNK];
+	float		in[CHUNK];
+
+	while (done < n) {
+		frames = CHUNK / (size_t)chans;
+		if (frames > n - done)
+			frames = n - done;
+		samples = frames * (size_t)chans;
+
+		fade_gains(curve, pos + done, len, frames, chans, out, in);
+		if (fmt == AV_SAMPLE_FMT_FLT)
+			mix_flt((float *)dst, (const float *)src,
+				out, in, samples);
+		else
+			mix_s16((int16_t *)dst, (const int16_t *)src,
+				out, in, samples);
+
+		dst += samples * bytes;
+		src += samples * bytes;
+		done += frames;
+	}
+}
+
+/* Used by the mixer to add each source into the output stream; silent (or
+ * paused) sources still go through here, so it needs to be cheap.
+ */
+void
+audio_conv_sum(enum AVSampleFormat fmt,
+	       int chans,
+	       char *dst,
+	       const char *src,
+	       size_t n,
+	       float gain)
+{
+	size_t		samples = n * (size_t)chans;
+
+	if (fmt == AV_SAMPLE_FMT_FLT)
+		sum_flt((float *)dst, (const float *)src, gain, samples);
+	else
+		sum_s16((int16_t *)dst, (const int16_t *)src, gain, samples);
+}
+
+/* 32-bit float is the natural choice, and what the mixing and resampling
+ * stages work in.  16-bit signed integer is there for devices that can't take
+ * floats, and is dithered when it loses resolution.
+ */
+enum error
+audio_conv_out_ok(enum AVSampleFormat fmt)
+{
+	enum error	err = E_OK;
+
+	if (fmt != AV_SAMPLE_FMT_FLT && fmt != AV_SAMPLE_FMT_S16)
+		err = error(E_BAD_CONFIG, "output format must be f32 or s16");
+
+	return err;
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/*----------------------------------------------------------------------------
+ *  Kernel selection
+ *----------------------------------------------------------------------------*/
+
+/* Picks a single-pass kernel for the conversion, or NULL if there isn't one. */
+static direct_fn
+pick_direct(enum AVSampleFormat in, int chans, enum AVSampleFormat out)
+{
+	direct_fn	fn = NULL;
+	int		stereo = (chans == 2);
+
+	if (in == out && out == AV_SAMPLE_FMT_S16)
+		fn = copy_packed16;
+	else if (in == out && out == AV_SAMPLE_FMT_FLT)
+		fn = copy_packed32;
+	else if (in == AV_SAMPLE_FMT_S16P && out == AV_SAMPLE_FMT_S16)
+		fn = stereo ? interleave16_stereo : interleave16;
+	else if (in == AV_SAMPLE_FMT_FLTP && out == AV_SAMPLE_FMT_FLT)
+		fn = stereo ? interleave32_stereo : interleave32;
+
+	return fn;
+}
+
+/* Picks the kernel that takes samples of the given format, planar or not, to
+ * floats; or NULL if the format isn't supported.
+ */
+static to_flt_fn
+pick_to_flt(enum AVSampleFormat in)
+{
+	to_flt_fn	fn = NULL;
+
+	switch (in) {
+	case AV_SAMPLE_FMT_U8:
+	case AV_SAMPLE_FMT_U8P:
+		fn = u8_to_flt;
+		break;
+	case AV_SAMPLE_FMT_S16:
+	case AV_SAMPLE_FMT_S16P:
+		fn = s16_to_flt;
+		break;
+	case AV_SAMPLE_FMT_S32:
+	case AV_SAMPLE_FMT_S32P:
+		fn = s32_to_flt;
+		break;
+	case AV_SAMPLE_FMT_FLT:
+	case AV_SAMPLE_FMT_FLTP:
+		fn = flt_to_flt;
+		break;
+	case AV_SAMPLE_FMT_DBL:
+	case AV_SAMPLE_FMT_DBLP:
+		fn = dbl_to_flt;
+		break;
+#ifdef HAVE_S64
+	case AV_SAMPLE_FMT_S64:
+	case AV_SAMPLE_FMT_S64P:
+		fn = s64_to_flt;
+		break;
+#endif				/* HAVE_S64 */
+	default:
+		break;
+	}
+
+	return fn;
+}
+
+/*----------------------------------------------------------------------------
+ *  Two-stage conversion
+ *----------------------------------------------------------------------------*/
+
+/* Converts up to CHUNK samples via floats. */
+static void
+run_chunk(struct au_conv *cv, char *dst, uint8_t *const *src,
+	  size_t offset, size_t n)
+{
+	int		c;
+	float          *mixed;
+	uint8_t        *planes[2];
+	size_t		chans = (size_t)cv->chans;
+
+	/* Float output can go straight to its destination */
+	mixed = (cv->out == AV_SAMPLE_FMT_FLT ? (float *)dst : cv->mixed);
+
+	if (!cv->planar && cv->in_chans == cv->chans)
+		cv->to_flt(mixed, src[0] + (offset * chans * cv->in_bps),
+			   n * chans);
+	else if (!cv->planar) {
+		cv->to_flt(cv->wide,
+			   src[0] + (offset * (size_t)cv->in_chans * cv->in_bps),
+			   n * (size_t)cv->in_chans);
+		remap(cv, mixed, cv->wide, n);
+	} else if (chans == 2) {
+		cv->to_flt(cv->plane[0],
+			   src[cv->map[0]] + (offset * cv->in_bps), n);
+		cv->to_flt(cv->plane[1],
+			   src[cv->map[1]] + (offset * cv->in_bps), n);
+		planes[0] = (uint8_t *)cv->plane[0];
+		planes[1] = (uint8_t *)cv->plane[1];
+		interleave32_stereo((char *)mixed, planes, 0, n, 2);
+	} else {
+		for (c = 0; c < cv->chans; c++) {
+			cv->to_flt(cv->plane[0],
+				   src[cv->map[c]] + (offset * cv->in_bps), n);
+			scatter(mixed + c, cv->plane[0], n, cv->chans);
+		}
+	}
+
+	if (cv->out == AV_SAMPLE_FMT_S16)
+		flt_to_s16(cv, (int16_t *)dst, mixed, n * chans);
+}
+
+/* Spreads 'n' samples from 'src' into every 'stride'th slot of 'dst'. */
+static void
+scatter(float *dst, const float *src, size_t n, int stride)
+{
+	size_t		i;
+
+	for (i = 0; i < n; i++)
+		dst[i * (size_t)stride] = src[i];
+}
+
+/* Picks the output channels out of 'n' packed samples of input channels. */
+static void
+remap(struct au_conv *cv, float *dst, const float *src, size_t n)
+{
+	size_t		i;
+	int		c;
+
+	for (i = 0; i < n; i++)
+		for (c = 0; c < cv->chans; c++)
+			*(dst++) = src[(i * (size_t)cv->in_chans) +
+				       (size_t)cv->map[c]];
+}
+
+/* Quantises 'n' floats to 16-bit integers with TPDF dither.
+ *
+ * The dither is the difference of two uniform random numbers in [0, 1) LSB,
+ * giving triangular noise in (-1, 1) LSB.  The random numbers come from four
+ * independent xorshift generators, one per vector lane, turned into floats by
+ * stuffing their top bits into the mantissa of a float in [1, 2).
+ */
+static void
+flt_to_s16(struct au_conv *cv, int16_t *dst, const float *src, size_t n)
+{
+	size_t		i = 0;
+	int		lane;
+	uint32_t	x;
+	union {
+		uint32_t	u;
+		float		f;
+	}		r1, r2;
+	float		v;
+
+#if defined(__SSE2__)
+	__m128i		st = _mm_loadu_si128((const __m128i *)cv->rng);
+	__m128i		ones = _mm_set1_epi32(0x3f800000);
+	__m128		scale = _mm_set1_ps(32768.0f);
+
+	for (; i + 8 <= n; i += 8) {
+		__m128		d[2];
+		__m128i		q[2];
+		int		k;
+
+		for (k = 0; k < 2; k++) {
+			__m128		u1;
+			__m128		u2;
+
+			st = _mm_xor_si128(st, _mm_slli_epi32(st, 13));
+			st = _mm_xor_si128(st, _mm_srli_epi32(st, 17));
+			st = _mm_xor_si128(st, _mm_slli_epi32(st, 5));
+			u1 = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(st, 9),
+							   ones));
+			st = _mm_xor_si128(st, _mm_slli_epi32(st, 13));
+			st = _mm_xor_si128(st, _mm_srli_epi32(st, 17));
+			st = _mm_xor_si128(st, _mm_slli_epi32(st, 5));
+			u2 = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(st, 9),
+							   ones));
+			/* The 1s in [1, 2) cancel out */
+			d[k] = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i + (4 * k)),
+						     scale),
+					  _mm_sub_ps(u1, u2));
+			/* Rounds to nearest; out of range gives INT_MIN */
+			d[k] = _mm_min_ps(d[k], _mm_set1_ps(32767.0f));
+			q[k] = _mm_cvtps_epi32(d[k]);
+		}
+		/* Saturating pack does the clipping */
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(q[0], q[1]));
+	}
+	_mm_storeu_si128((__m128i *)cv->rng, st);
+#endif				/* __SSE2__ */
+
+	for (lane = 0; i < n; i++, lane = (lane + 1) % 4) {
+		x = cv->rng[lane];
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		r1.u = (x >> 9) | 0x3f800000;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		r2.u = (x >> 9) | 0x3f800000;
+		cv->rng[lane] = x;
+
+		v = (src[i] * 32768.0f) + (r1.f - r2.f);
+		if (v >= 32767.0f)
+			dst[i] = 32767;
+		else if (v <= -32768.0f)
+			dst[i] = -32768;
+		else
+			/* Round half away from zero; C99 lrintf would do but
+			 * depends on the rounding mode.
+			 */
+			dst[i] = (int16_t)(v < 0 ? v - 0.5f : v + 0.5f);
+	}
+}
+
+/*----------------------------------------------------------------------------
+ *  Crossfading
+ *----------------------------------------------------------------------------*/
+
+/* Works out the outgoing and incoming gains for 'n' frames of 'chans'
+ * channels, 'pos' frames into a crossfade 'len' frames long, repeating each
+ * gain across its frame's channels.
+ */
+static void
+fade_gains(enum xfade_curve curve, size_t pos, size_t len,
+	   size_t n, int chans, float *out, float *in)
+{
+	size_t		i;
+	int		c;
+	float		t;
+	float		go;
+	float		gi;
+
+	for (i = 0; i < n; i++) {
+		t = (float)(pos + i) / (float)len;
+		if (t > 1.0f)
+			t = 1.0f;
+		if (curve == XF_EQUAL_POWER) {
+			go = cosf(t * HALF_PI);
+			gi = sinf(t * HALF_PI);
+		} else {
+			go = 1.0f - t;
+			gi = t;
+		}
+		for (c = 0; c < chans; c++) {
+			out[(i * (size_t)chans) + (size_t)c] = go;
+			in[(i * (size_t)chans) + (size_t)c] = gi;
+		}
+	}
+}
+
+static void
+mix_flt(float *dst, const float *src, const float *out, const float *in,
+	size_t n)
+{
+	size_t		i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 8 <= n; i += 8) {
+		__m256		d = _mm256_loadu_ps(dst + i);
+		__m256		s = _mm256_loadu_ps(src + i);
+
+		d = _mm256_add_ps(_mm256_mul_ps(d, _mm256_loadu_ps(out + i)),
+				  _mm256_mul_ps(s, _mm256_loadu_ps(in + i)));
+		_mm256_storeu_ps(dst + i, d);
+	}
+#endif				/* __AVX2__ */
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4) {
+		__m128		d = _mm_loadu_ps(dst + i);
+		__m128		s = _mm_loadu_ps(src + i);
+
+		d = _mm_add_ps(_mm_mul_ps(d, _mm_loadu_ps(out + i)),
+			       _mm_mul_ps(s, _mm_loadu_ps(in + i)));
+		_mm_storeu_ps(dst + i, d);
+	}
+#endif				/* __SSE2__ */
+	for (; i < n; i++)
+		dst[i] = (dst[i] * out[i]) + (src[i] * in[i]);
+}
+
+/* The gains never add up to more than sqrt(2), and then only with the equal
+ * power curve and both sides at full scale, but that's enough to need
+ * clipping.
+ */
+static void
+mix_s16(int16_t *dst, const int16_t *src, const float *out, const float *in,
+	size_t n)
+{
+	size_t		i;
+	float		v;
+
+	for (i = 0; i < n; i++) {
+		v = ((float)dst[i] * out[i]) + ((float)src[i] * in[i]);
+		if (v > 32767.0f)
+			v = 32767.0f;
+		else if (v < -32768.0f)
+			v = -32768.0f;
+		dst[i] = (int16_t)lrintf(v);
+	}
+}
+
+/*----------------------------------------------------------------------------
+ *  Summing
+ *----------------------------------------------------------------------------*/
+
+static void
+sum_flt(float *dst, const float *src, float gain, size_t n)
+{
+	size_t		i = 0;
+
+#if defined(__AVX2__)
+	__m256		g8 = _mm256_set1_ps(gain);
+
+	for (; i + 8 <= n; i += 8) {
+		__m256		s = _mm256_mul_ps(_mm256_loadu_ps(src + i), g8);
+
+		_mm256_storeu_ps(dst + i,
+				 _mm256_add_ps(_mm256_loadu_ps(dst + i), s));
+	}
+#endif				/* __AVX2__ */
+#if defined(__SSE2__)
+	__m128		g4 = _mm_set1_ps(gain);
+
+	for (; i + 4 <= n; i += 4) {
+		__m128		s = _mm_mul_ps(_mm_loadu_ps(src + i), g4);
+
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), s));
+	}
+#endif				/* __SSE2__ */
+	for (; i < n; i++)
+		dst[i] += src[i] * gain;
+}
+
+/* At unity gain, which is by far the commonest, this is a straight saturating
+ * add; otherwise each sample goes through float and is clipped by hand.
+ */
+static void
+sum_s16(int16_t *dst, const int16_t *src, float gain, size_t n)
+{
+	size_t		i = 0;
+	float		v;
+
+	if (gain == 1.0f) {
+#if defined(__AVX2__)
+		for (; i + 16 <= n; i += 16) {
+			__m256i		d = _mm256_loadu_si256((const __m256i *)
+							       (dst + i));
+			__m256i		s = _mm256_loadu_si256((const __m256i *)
+							       (src + i));
+
+			_mm256_storeu_si256((__m256i *)(dst + i),
+					    _mm256_adds_epi16(d, s));
+		}
+#endif				/* __AVX2__ */
+#if defined(__SSE2__)
+		for (; i + 8 <= n; i += 8) {
+			__m128i		d = _mm_loadu_si128((const __m128i *)
+							    (dst + i));
+			__m128i		s = _mm_loadu_si128((const __m128i *)
+							    (src + i));
+
+			_mm_storeu_si128((__m128i *)(dst + i),
+					 _mm_adds_epi16(d, s));
+		}
+#endif				/* __SSE2__ */
+	}
+	for (; i < n; i++) {
+		v = (float)dst[i] + ((float)src[i] * gain);
+		if (v > 32767.0f)
+			v = 32767.0f;
+		else if (v < -32768.0f)
+			v = -32768.0f;
+		dst[i] = (int16_t)lrintf(v);
+	}
+}
+
+/*----------------------------------------------------------------------------
+ *  Direct kernels
+ *----------------------------------------------------------------------------*/
+
+/* Packed samples are already interleaved, so these are just copies. */
+
+static void
+copy_packed16(char *dst, uint8_t *const *src, size_t offset,
+	      size_t n, int chans)
+{
+	size_t		frame = sizeof(int16_t) * (size_t)chans;
+
+	memcpy(dst, src[0] + (offset * frame), n * frame);
+}
+
+static void
+copy_packed32(char *dst, uint8_t *const *src, size_t offset,
+	      size_t n, int chans)
+{
+	size_t		frame = sizeof(int32_t) * (size_t)chans;
+
+	memcpy(dst, src[0] + (offset * frame), n * frame);
+}
+
+/* These work by sample size alone, as interleaving doesn't care what the bits
+ * mean; floats go through interleave32.
+ */
+
+static void
+interleave16(char *dst, uint8_t *const *src, size_t offset,
+	     size_t n, int chans)
+{
+	size_t		i;
+	int		c;
+	int16_t        *d = (int16_t *)dst;
+
+	for (i = 0; i < n; i++)
+		for (c = 0; c < chans; c++)
+			*(d++) = ((const int16_t *)src[c])[offset + i];
+}
+
+static void
+interleave32(char *dst, uint8_t *const *src, size_t offset,
+	     size_t n, int chans)
+{
+	size_t		i;
+	int		c;
+	int32_t        *d = (int32_t *)dst;
+
+	for (i = 0; i < n; i++)
+		for (c = 0; c < chans; c++)
+			*(d++) = ((const int32_t *)src[c])[offset + i];
+}
+
+/* Each of the stereo kernels does as much as it can with the widest vectors
+ * available, then mops up the tail one sample at a time.  Loads and stores are
+ * unaligned, as the offset and the ring buffer's wrap point can land anywhere.
+ */
+
+static void
+interleave16_stereo(char *dst, uint8_t *const *src, size_t offset,
+		    size_t n, int chans)
+{
+	size_t		i = 0;
+	const int16_t  *l = (const int16_t *)src[0] + offset;
+	const int16_t  *r = (const int16_t *)src[1] + offset;
+	int16_t        *d = (int16_t *)dst;
+
+	chans = (int)chans;	/* Always 2 */
+
+#if defined(__AVX2__)
+	for (; i + 16 <= n; i += 16) {
+		__m256i		vl = _mm256_loadu_si256((const __m256i *)(l + i));
+		__m256i		vr = _mm256_loadu_si256((const __m256i *)(r + i));
+		__m256i		lo = _mm256_unpacklo_epi16(vl, vr);
+		__m256i		hi = _mm256_unpackhi_epi16(vl, vr);
+
+		/* unpack works within 128-bit lanes, so put them in order */
+		_mm256_storeu_si256((__m256i *)(d + (2 * i)),
+				    _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(d + (2 * i) + 16),
+				    _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+#endif				/* __AVX2__ */
+#if defined(__SSE2__)
+	for (; i + 8 <= n; i += 8) {
+		__m128i		vl = _mm_loadu_si128((const __m128i *)(l + i));
+		__m128i		vr = _mm_loadu_si128((const __m128i *)(r + i));
+
+		_mm_storeu_si128((__m128i *)(d + (2 * i)),
+				 _mm_unpacklo_epi16(vl, vr));
+		_mm_storeu_si128((__m128i *)(d + (2 * i) + 8),
+				 _mm_unpackhi_epi16(vl, vr));
+	}
+#endif				/* __SSE2__ */
+	for (; i < n; i++) {
+		d[2 * i] = l[i];
+		d[(2 * i) + 1] = r[i];
+	}
+}
+
+static void
+interleave32_stereo(char *dst, uint8_t *const *src, size_t offset,
+		    size_t n, int chans)
+{
+	size_t		i = 0;
+	const int32_t  *l = (const int32_t *)src[0] + offset;
+	const int32_t  *r = (const int32_t *)src[1] + offset;
+	int32_t        *d = (int32_t *)dst;
+
+	chans = (int)chans;	/* Always 2 */
+
+#if defined(__AVX2__)
+	for (; i + 8 <= n; i += 8) {
+		__m256i		vl = _mm256_loadu_si256((const __m256i *)(l + i));
+		__m256i		vr = _mm256_loadu_si256((const __m256i *)(r + i));
+		__m256i		lo = _mm256_unpacklo_epi32(vl, vr);
+		__m256i		hi = _mm256_unpackhi_epi32(vl, vr);
+
+		/* unpack works within 128-bit lanes, so put them in order */
+		_mm256_storeu_si256((__m256i *)(d + (2 * i)),
+				    _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(d + (2 * i) + 8),
+				    _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+#endif				/* __AVX2__ */
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4) {
+		__m128i		vl = _mm_loadu_si128((const __m128i *)(l + i));
+		__m128i		vr = _mm_loadu_si128((const __m128i *)(r + i));
+
+		_mm_storeu_si128((__m128i *)(d + (2 * i)),
+				 _mm_unpacklo_epi32(vl, vr));
+		_mm_storeu_si128((__m128i *)(d + (2 * i) + 4),
+				 _mm_unpackhi_epi32(vl, vr));
+	}
+#endif				/* __SSE2__ */
+	for (; i < n; i++) {
+		d[2 * i] = l[i];
+		d[(2 * i) + 1] = r[i];
+	}
+}
+
+/*----------------------------------------------------------------------------
+ *  To-float kernels
+ *----------------------------------------------------------------------------*/
+
+static void
+u8_to_flt(float *dst, const uint8_t *src, size_t n)
+{
+	size_t		i = 0;
+
+#if defined(__SSE2__)
+	__m128i		zero = _mm_setzero_si128();
+	__m128i		bias = _mm_set1_epi32(128);
+	__m128		scale = _mm_set1_ps(1.0f / 128.0f);
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i		v = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i		w[2];
+		int		k;
+
+		w[0] = _mm_unpacklo_epi8(v, zero);
+		w[1] = _mm_unpackhi_epi8(v, zero);
+		for (k = 0; k < 2; k++) {
+			__m128i		lo = _mm_unpacklo_epi16(w[k], zero);
+			__m128i		hi = _mm_unpackhi_epi16(w[k], zero);
+
+			lo = _mm_sub_epi32(lo, bias);
+			hi = _mm_sub_epi32(hi, bias);
+			_mm_storeu_ps(dst + i + (8 * k),
+				      _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+			_mm_storeu_ps(dst + i + (8 * k) + 4,
+				      _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+		}
+	}
+#endif				/* __SSE2__ */
+	for (; i < n; i++)
+		dst[i] = ((float)src[i] - 128.0f) * (1.0f / 128.0f);
+}
+
+static void
+s16_to_flt(float *dst, const uint8_t *src, size_t n)
+{
+	size_t		i = 0;
+	const int16_t  *s = (const int16_t *)src;
+
+#if defined(__SSE2__)
+	__m128		scale = _mm_set1_ps(1.0f / 32768.0f);
+
+	for (; i + 8 <= n; i += 8) {
+		__m128i		v = _mm_loadu_si128((const __m128i *)(s + i));
+		/* Sign-extend by putting each sample in the top half */
+		__m128i		lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i		hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(dst + i + 4,
+			      _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+#endif				/* __SSE2__ */
+	for (; i < n; i++)
+		dst[i] = (float)s[i] * (1.0f / 32768.0f);
+}
+
+static void
+s32_to_flt(float *dst, const uint8_t *src, size_t n)
+{
+	size_t		i = 0;
+	const int32_t  *s = (const int32_t *)src;
+
+#if defined(__AVX2__)
+	__m256		wscale = _mm256_set1_ps(1.0f / 2147483648.0f);
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i		v = _mm256_loadu_si256((const __m256i *)(s + i));
+
+		_mm256_storeu_ps(dst + i,
+				 _mm256_mul_ps(_mm256_cvtepi32_ps(v), wscale));
+	}
+#endif				/* __AVX2__ */
+#if defined(__SSE2__)
+	__m128		scale = _mm_set1_ps(1.0f / 2147483648.0f);
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i		v = _mm_loadu_si128((const __m128i *)(s + i));
+
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+#endif				/* __SSE2__ */
+	for (; i < n; i++)
+		dst[i] = (float)s[i] * (1.0f / 2147483648.0f);
+}
+
+static void
+flt_to_flt(float *dst, const uint8_t *src, size_t n)
+{
+	memcpy(dst, src, n * sizeof(float));
+}
+
+static void
+dbl_to_flt(float *dst, const uint8_t *src, size_t n)
+{
+	size_t		i = 0;
+	const double   *s = (const double *)src;
+
+#if defined(__AVX2__)
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_loadu_pd(s + i)));
+#endif				/* __AVX2__ */
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4) {
+		__m128		lo = _mm_cvtpd_ps(_mm_loadu_pd(s + i));
+		__m128		hi = _mm_cvtpd_ps(_mm_loadu_pd(s + i + 2));
+
+		_mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+	}
+#endif				/* __SSE2__ */
+	for (; i < n; i++)
+		dst[i] = (float)s[i];
+}
+
+#ifdef HAVE_S64
+/* Neither SSE2 nor AVX2 can convert 64-bit integers, so this one is scalar. */
+static void
+s64_to_flt(float *dst, const uint8_t *src, size_t n)
+{
+	size_t		i;
+	const int64_t  *s = (const int64_t *)src;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (float)((double)s[i] * (1.0 / 9223372036854775808.0));
+}
+#endif				/* HAVE_S64 */
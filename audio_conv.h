@@ -0,0 +1,137 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  audio_conv.h
+ *
+ *    Description:  Interface to the sample format conversion kernels
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef AUDIO_CONV_H
+#define AUDIO_CONV_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stddef.h>		/* size_t */
+#include <stdint.h>		/* uint8_t */
+
+#include <libavutil/samplefmt.h>	/* enum AVSampleFormat */
+
+#include "cuppa/errors.h"	/* enum error */
+
+/**  DATA TYPES  **************************************************************/
+
+/* Shapes of crossfade (see audio_conv_mix). */
+enum xfade_curve {
+	XF_LINEAR,		/* Gains add up to 1; dips in the middle */
+	XF_EQUAL_POWER,		/* Powers add up to 1; even loudness */
+	/*--------------------------------------------------------------------*/
+	NUM_XFADE_CURVES	/* Number of items in enum */
+};
+
+/* The conversion structure holds everything needed to turn decoded frames of
+ * one sample format into interleaved samples of the output format, including
+ * scratch space and dither state.
+ *
+ * struct au_conv is an opaque structure; only audio_conv.c knows its true
+ * definition.
+ */
+struct au_conv;
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* Sets up conversion from frames of sample format 'in', with 'in_chans'
+ * channels, to interleaved samples of sample format 'out' with 'out_chans'
+ * channels.
+ *
+ * 'out' must be one of the formats audio_conv_out_ok accepts.
+ */
+enum error
+audio_conv_init(struct au_conv **cv,
+		enum AVSampleFormat in,
+		int in_chans,
+		enum AVSampleFormat out,
+		int out_chans);
+void		audio_conv_free(struct au_conv *cv);
+
+/* Converts 'n' samples, starting 'offset' samples in, from the decoded frame
+ * data 'src' (one pointer per channel if the frame is planar, or just src[0]
+ * if it is packed) and writes them, interleaved, to 'dst'.
+ */
+void
+audio_conv_run(struct au_conv *cv,
+	       char *dst,
+	       uint8_t *const *src,
+	       size_t offset,
+	       size_t n);
+
+/* Like audio_conv_sum, but with 'gain' scaled by a linear ramp from silence
+ * to full volume over 'len' samples, of which 'pos' have already gone by.
+ */
+void
+audio_conv_sum_ramp(enum AVSampleFormat fmt,
+		    int chans,
+		    char *dst,
+		    const char *src,
+		    size_t n,
+		    float gain,
+		    size_t pos,
+		    size_t len);
+
+/* Crossfades 'n' interleaved samples of output format 'fmt', with 'chans'
+ * channels, from those at 'dst' to those at 'src', following 'curve' over
+ * 'len' samples of which 'pos' have already gone by.  The mix goes in 'dst'.
+ */
+void
+audio_conv_mix(enum AVSampleFormat fmt,
+	       int chans,
+	       char *dst,
+	       const char *src,
+	       size_t n,
+	       size_t pos,
+	       size_t len,
+	       enum xfade_curve curve);
+
+/* Adds 'n' interleaved samples of output format 'fmt', with 'chans' channels,
+ * from 'src', scaled by 'gain', into those at 'dst', clipping if the format
+ * can't go past full scale.
+ */
+void
+audio_conv_sum(enum AVSampleFormat fmt,
+	       int chans,
+	       char *dst,
+	       const char *src,
+	       size_t n,
+	       float gain);
+
+/* Checks whether 'fmt' can be used as an output format. */
+enum error	audio_conv_out_ok(enum AVSampleFormat fmt);
+
+#endif				/* not AUDIO_CONV_H */
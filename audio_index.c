@@ -0,0 +1,509 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  audio_index.c
+ *
+ *    Description:  The per-file seek index and its on-disk cache
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>		/* PRIx64 */
+#include <pthread.h>
+#include <stdbool.h>		/* bool */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>		/* stat, mkdir */
+
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>	/* av_rescale_q */
+
+#include "cuppa/errors.h"	/* dbug, error */
+
+#include "audio_index.h"
+#include "constants.h"
+
+/**  MACROS  ******************************************************************/
+
+#define CACHE_PATH_LEN 1024	/* Max. length of a cache file's path */
+
+/**  DATA TYPES  **************************************************************/
+
+/* One indexed packet. */
+struct ix_entry {
+	int64_t		pos;	/* Byte offset of the packet in the file */
+	int64_t		ts;	/* Its timestamp, in the stream's time base */
+};
+
+/* The start of a cache file, which is followed by the file's path (to catch
+ * hash collisions) and then 'count' struct ix_entry.
+ *
+ * The cache is only ever read back on the machine that wrote it, so this is
+ * just dumped in native byte order.
+ */
+struct ix_header {
+	char		magic[4];	/* Always CACHE_MAGIC */
+	uint32_t	version;	/* Always CACHE_VERSION */
+	int64_t		size;	/* Size of the file when indexed */
+	int64_t		mtime;	/* Modification time of the file then */
+	int32_t		stream;	/* Stream the index is for */
+	uint32_t	path_len;	/* Length of the path that follows */
+	uint64_t	count;	/* Number of entries */
+};
+
+struct au_index {
+	char           *path;	/* File being indexed */
+	int		stream;	/* Stream being indexed */
+	int64_t		size;	/* Size of the file at open */
+	int64_t		mtime;	/* Modification time of the file at open */
+	struct ix_entry *entries;	/* Entries, in timestamp order */
+	size_t		count;	/* Number of entries */
+	pthread_t	builder;	/* Thread building the index */
+	pthread_mutex_t	lock;	/* Protects the flags below */
+	bool		building;	/* Is 'builder' joinable? */
+	bool		ready;	/* Can 'entries' be used? */
+	bool		quit;	/* Should 'builder' give up? */
+};
+
+/**  GLOBAL VARIABLES  ********************************************************/
+
+static const char CACHE_MAGIC[4] = {'P', 'S', 'I', 'X'};
+static const uint32_t CACHE_VERSION = 1;
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static void    *builder_main(void *v_ix);
+static enum error build(struct au_index *ix, struct ix_entry **entries,
+			size_t *count);
+static int	interrupted(void *v_ix);
+static enum error add_entry(struct ix_entry **entries, size_t *count,
+			    size_t *cap, int64_t pos, int64_t ts);
+static enum error load_cache(struct au_index *ix);
+static enum error save_cache(struct au_index *ix);
+static enum error cache_path(struct au_index *ix, char *buf, bool make);
+static uint64_t	hash_path(const char *path);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+enum error
+audio_index_open(struct au_index **ix, const char *path, int stream)
+{
+	struct stat	st;
+	enum error	err = E_OK;
+
+	*ix = calloc((size_t)1, sizeof(struct au_index));
+	if (*ix == NULL)
+		err = error(E_NO_MEM, "can't alloc index structure");
+	if (err == E_OK) {
+		(*ix)->stream = stream;
+		(*ix)->path = strdup(path);
+		if ((*ix)->path == NULL)
+			err = error(E_NO_MEM, "can't alloc index path");
+	}
+	/* Streams and the like have nothing to index */
+	if (err == E_OK && stat((*ix)->path, &st) != 0)
+		err = E_NO_FILE;
+	if (err == E_OK) {
+		(*ix)->size = (int64_t)st.st_size;
+		(*ix)->mtime = (int64_t)st.st_mtime;
+		if (pthread_mutex_init(&(*ix)->lock, NULL) != 0)
+			err = error(E_INTERNAL_ERROR, "can't init index lock");
+	}
+	if (err == E_OK) {
+		if (load_cache(*ix) == E_OK)
+			(*ix)->ready = true;
+		else if (pthread_create(&(*ix)->builder, NULL, builder_main,
+					(void *)*ix) != 0)
+			err = error(E_INTERNAL_ERROR, "can't start indexer");
+		else
+			(*ix)->building = true;
+	}
+	return err;
+}
+
+void
+audio_index_close(struct au_index *ix)
+{
+	if (ix != NULL) {
+		if (ix->building) {
+			pthread_mutex_lock(&ix->lock);
+			ix->quit = true;
+			pthread_mutex_unlock(&ix->lock);
+			pthread_join(ix->builder, NULL);
+		}
+		pthread_mutex_destroy(&ix->lock);
+		free(ix->entries);
+		free(ix->path);
+		free(ix);
+	}
+}
+
+void
+audio_index_wait(struct au_index *ix)
+{
+	if (ix != NULL && ix->building) {
+		pthread_join(ix->builder, NULL);
+		ix->building = false;
+	}
+}
+
+/* The entries are sorted by timestamp, so this is a binary search. */
+bool
+audio_index_find(struct au_index *ix, int64_t ts, int64_t *pos, int64_t *found)
+{
+	size_t		lo;
+	size_t		hi;
+	size_t		mid;
+	bool		ok = false;
+
+	if (ix != NULL) {
+		pthread_mutex_lock(&ix->lock);
+		ok = (ix->ready && ix->count > 0 && ix->entries[0].ts <= ts);
+	}
+	if (ok) {
+		/* Invariant: entries[lo].ts <= ts < entries[hi].ts */
+		lo = 0;
+		hi = ix->count;
+		while (hi - lo > 1) {
+			mid = lo + (hi - lo) / 2;
+			if (ix->entries[mid].ts <= ts)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		*pos = ix->entries[lo].pos;
+		*found = ix->entries[lo].ts;
+	}
+	if (ix != NULL)
+		pthread_mutex_unlock(&ix->lock);
+
+	return ok;
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/*----------------------------------------------------------------------------
+ *  Building the index
+ *----------------------------------------------------------------------------*/
+
+/* Builds the index, caches it and hands it over to audio_index_find. */
+static void *
+builder_main(void *v_ix)
+{
+	struct ix_entry *entries = NULL;
+	size_t		count = 0;
+	struct au_index *ix = (struct au_index *)v_ix;
+
+	if (build(ix, &entries, &count) == E_OK && !interrupted(v_ix)) {
+		dbug("indexed %s: %zu entries", ix->path, count);
+
+		pthread_mutex_lock(&ix->lock);
+		ix->entries = entries;
+		ix->count = count;
+		ix->ready = true;
+		pthread_mutex_unlock(&ix->lock);
+
+		/* Nothing else touches the entries now they're ready */
+		if (save_cache(ix) != E_OK)
+			dbug("couldn't cache index for %s", ix->path);
+	} else
+		free(entries);
+
+	return NULL;
+}
+
+/* Reads through the file's packets (without decoding them) and notes down
+ * where they are.
+ *
+ * This uses its own demuxer, so it doesn't disturb the one playing the file;
+ * it only needs the packet headers, so it is far quicker than decoding.
+ * Entries are thinned out to at most one per INDEX_INTERVAL_USECS.
+ */
+static enum error
+build(struct au_index *ix, struct ix_entry **entries, size_t *count)
+{
+	AVFormatContext *ctx;
+	AVPacket	packet;
+	int64_t		ts;
+	int64_t		interval = 0;
+	int64_t		last = 0;
+	size_t		cap = 0;
+	enum error	err = E_OK;
+
+	ctx = avformat_alloc_context();
+	if (ctx == NULL)
+		err = error(E_NO_MEM, "can't alloc indexer context");
+	if (err == E_OK) {
+		/* Lets audio_index_close cut short any blocking reads */
+		ctx->interrupt_callback.callback = interrupted;
+		ctx->interrupt_callback.opaque = (void *)ix;
+		/* avformat_open_input frees the context if it fails */
+		if (avformat_open_input(&ctx, ix->path, NULL, NULL) < 0)
+			err = error(E_NO_FILE, "indexer couldn't open %s",
+				    ix->path);
+	}
+	if (err == E_OK && (unsigned int)ix->stream >= ctx->nb_streams)
+		err = error(E_BAD_FILE, "indexer can't find stream");
+	if (err == E_OK)
+		interval = av_rescale_q((int64_t)INDEX_INTERVAL_USECS,
+					AV_TIME_BASE_Q,
+					ctx->streams[ix->stream]->time_base);
+
+	av_init_packet(&packet);
+	packet.data = NULL;
+	packet.size = 0;
+	while (err == E_OK && !interrupted((void *)ix) &&
+	       av_read_frame(ctx, &packet) >= 0) {
+		ts = (packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts);
+		if (packet.stream_index == ix->stream &&
+		    packet.pos >= 0 &&
+		    ts != AV_NOPTS_VALUE &&
+		    (*count == 0 || ts >= last + interval)) {
+			err = add_entry(entries, count, &cap, packet.pos, ts);
+			last = ts;
+		}
+		av_free_packet(&packet);
+	}
+
+	if (ctx != NULL)
+		avformat_close_input(&ctx);
+	return err;
+}
+
+/* Tells ffmpeg, and the builder, whether to give up; see
+ * audio_index_close.
+ */
+static int
+interrupted(void *v_ix)
+{
+	bool		quit;
+	struct au_index *ix = (struct au_index *)v_ix;
+
+	pthread_mutex_lock(&ix->lock);
+	quit = ix->quit;
+	pthread_mutex_unlock(&ix->lock);
+
+	return (int)quit;
+}
+
+/* Appends an entry to the array being built, growing it if need be. */
+static enum error
+add_entry(struct ix_entry **entries, size_t *count, size_t *cap,
+	  int64_t pos, int64_t ts)
+{
+	struct ix_entry *bigger;
+	enum error	err = E_OK;
+
+	if (*count == *cap) {
+		*cap = (*cap == 0 ? 1024 : *cap * 2);
+		bigger = realloc(*entries, *cap * sizeof(struct ix_entry));
+		if (bigger == NULL)
+			err = error(E_NO_MEM, "can't grow index");
+		else
+			*entries = bigger;
+	}
+	if (err == E_OK) {
+		(*entries)[*count].pos = pos;
+		(*entries)[*count].ts = ts;
+		(*count)++;
+	}
+	return err;
+}
+
+/*----------------------------------------------------------------------------
+ *  The on-disk cache
+ *----------------------------------------------------------------------------*/
+
+/* Tries to load the index from the cache.  The cached copy is only used if
+ * the file's size and modification time haven't changed since it was made.
+ */
+static enum error
+load_cache(struct au_index *ix)
+{
+	char		path[CACHE_PATH_LEN];
+	char	       *cached_path = NULL;
+	FILE	       *f = NULL;
+	struct ix_header h;
+	enum error	err = E_OK;
+
+	err = cache_path(ix, path, false);
+	if (err == E_OK) {
+		f = fopen(path, "rb");
+		if (f == NULL)
+			err = E_NO_FILE;	/* Not cached; not an error */
+	}
+	if (err == E_OK && fread(&h, sizeof(h), (size_t)1, f) != 1)
+		err = E_BAD_FILE;
+	if (err == E_OK &&
+	    (memcmp(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+	     h.version != CACHE_VERSION ||
+	     h.size != ix->size ||
+	     h.mtime != ix->mtime ||
+	     h.stream != (int32_t)ix->stream ||
+	     h.path_len != (uint32_t)strlen(ix->path) ||
+	     h.count > (uint64_t)ix->size))	/* Sanity check */
+		err = E_BAD_FILE;
+	if (err == E_OK) {
+		cached_path = calloc((size_t)h.path_len + 1, sizeof(char));
+		if (cached_path == NULL)
+			err = error(E_NO_MEM, "can't alloc cached path");
+	}
+	if (err == E_OK &&
+	    (fread(cached_path, sizeof(char), (size_t)h.path_len, f) !=
+	     (size_t)h.path_len || strcmp(cached_path, ix->path) != 0))
+		err = E_BAD_FILE;
+	if (err == E_OK) {
+		ix->entries = calloc((size_t)h.count, sizeof(struct ix_entry));
+		if (ix->entries == NULL && h.count > 0)
+			err = error(E_NO_MEM, "can't alloc cached index");
+	}
+	if (err == E_OK &&
+	    fread(ix->entries, sizeof(struct ix_entry), (size_t)h.count, f) !=
+	    (size_t)h.count)
+		err = E_BAD_FILE;
+	if (err == E_OK) {
+		ix->count = (size_t)h.count;
+		dbug("loaded cached index for %s", ix->path);
+	} else {
+		free(ix->entries);
+		ix->entries = NULL;
+	}
+
+	free(cached_path);
+	if (f != NULL)
+		fclose(f);
+	return err;
+}
+
+/* Writes the index out to the cache.
+ *
+ * It goes to a temporary file first, and is renamed into place, so that a
+ * half-written cache file is never read back.
+ */
+static enum error
+save_cache(struct au_index *ix)
+{
+	char		path[CACHE_PATH_LEN];
+	char		tmp[CACHE_PATH_LEN + 4];
+	FILE	       *f = NULL;
+	struct ix_header h;
+	enum error	err = E_OK;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	h.version = CACHE_VERSION;
+	h.size = ix->size;
+	h.mtime = ix->mtime;
+	h.stream = (int32_t)ix->stream;
+	h.path_len = (uint32_t)strlen(ix->path);
+	h.count = (uint64_t)ix->count;
+
+	err = cache_path(ix, path, true);
+	if (err == E_OK) {
+		snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+		f = fopen(tmp, "wb");
+		if (f == NULL)
+			err = error(E_NO_FILE, "can't create %s", tmp);
+	}
+	if (err == E_OK &&
+	    (fwrite(&h, sizeof(h), (size_t)1, f) != 1 ||
+	     fwrite(ix->path, sizeof(char), (size_t)h.path_len, f) !=
+	     (size_t)h.path_len ||
+	     fwrite(ix->entries, sizeof(struct ix_entry), ix->count, f) !=
+	     ix->count))
+		err = error(E_INTERNAL_ERROR, "can't write %s", tmp);
+	if (f != NULL && fclose(f) != 0 && err == E_OK)
+		err = error(E_INTERNAL_ERROR, "can't write %s", tmp);
+	if (err == E_OK && rename(tmp, path) != 0)
+		err = error(E_INTERNAL_ERROR, "can't rename %s", tmp);
+	if (err != E_OK && f != NULL)
+		remove(tmp);
+
+	return err;
+}
+
+/* Works out where the cache file for 'ix' lives, putting the path in 'buf'
+ * (which must hold CACHE_PATH_LEN bytes).  If 'make' is true, the cache
+ * directory is created if it doesn't exist.
+ *
+ * The cache lives in $PLAYSLAVE_INDEX_DIR if set, else in the playslave
+ * directory of the XDG cache directory ($XDG_CACHE_HOME, or $HOME/.cache).
+ */
+static enum error
+cache_path(struct au_index *ix, char *buf, bool make)
+{
+	char		dir[CACHE_PATH_LEN];
+	const char     *env;
+	int		len = -1;
+	enum error	err = E_OK;
+
+	if ((env = getenv("PLAYSLAVE_INDEX_DIR")) != NULL) {
+		len = snprintf(dir, sizeof(dir), "%s", env);
+	} else if ((env = getenv("XDG_CACHE_HOME")) != NULL) {
+		if (make)
+			mkdir(env, 0700);
+		len = snprintf(dir, sizeof(dir), "%s/playslave", env);
+	} else if ((env = getenv("HOME")) != NULL) {
+		len = snprintf(dir, sizeof(dir), "%s/.cache", env);
+		if (make && len > 0 && (size_t)len < sizeof(dir))
+			mkdir(dir, 0700);
+		len = snprintf(dir, sizeof(dir), "%s/.cache/playslave", env);
+	}
+	if (len < 0 || (size_t)len >= sizeof(dir))
+		err = E_NO_FILE;	/* Nowhere to cache */
+	if (err == E_OK && make && mkdir(dir, 0755) != 0 && errno != EEXIST)
+		err = error(E_NO_FILE, "can't create %s", dir);
+	if (err == E_OK) {
+		len = snprintf(buf, CACHE_PATH_LEN, "%s/%016" PRIx64 "-%d.idx",
+			       dir, hash_path(ix->path), ix->stream);
+		if (len < 0 || len >= CACHE_PATH_LEN)
+			err = E_NO_FILE;
+	}
+	return err;
+}
+
+/* 64-bit FNV-1a hash of a path, for naming its cache file. */
+static uint64_t
+hash_path(const char *path)
+{
+	uint64_t	h = UINT64_C(14695981039346656037);
+
+	for (; *path != '\0'; path++) {
+		h ^= (uint64_t)(unsigned char)*path;
+		h *= UINT64_C(1099511628211);
+	}
+	return h;
+}
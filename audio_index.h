@@ -0,0 +1,90 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  audio_index.h
+ *
+ *    Description:  Interface to the per-file seek index
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef AUDIO_INDEX_H
+#define AUDIO_INDEX_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+#include <stdint.h>		/* int64_t */
+
+#include "cuppa/errors.h"	/* enum error */
+
+/**  DATA TYPES  **************************************************************/
+
+/* The seek index maps timestamps in one stream of a file to the byte offsets
+ * of the packets that start there, so that seeks can go straight to the right
+ * place instead of having the demuxer scan or guess.
+ *
+ * Indexes are kept in an on-disk cache between runs; if a file isn't in the
+ * cache, its index is built in the background, and isn't used until it's
+ * finished.
+ *
+ * struct au_index is an opaque structure; only audio_index.c knows its true
+ * definition.
+ */
+struct au_index;
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* Gets an index for stream 'stream' of the file in 'path', loading it from the
+ * cache or starting a thread to build it.
+ */
+enum error
+audio_index_open(struct au_index **ix,
+		 const char *path,
+		 int stream);
+void		audio_index_close(struct au_index *ix);
+
+/* Waits for the index to finish building, if it is being built; it can be
+ * used straight away afterwards, unless building failed.
+ */
+void		audio_index_wait(struct au_index *ix);
+
+/* Looks up the last indexed packet at or before timestamp 'ts' (in the
+ * stream's time base), putting its byte offset in *pos and its timestamp in
+ * *found.
+ *
+ * Returns false if the index isn't ready yet or has nothing early enough.
+ */
+bool
+audio_index_find(struct au_index *ix,
+		 int64_t ts,
+		 int64_t *pos,
+		 int64_t *found);
+
+#endif				/* not AUDIO_INDEX_H */
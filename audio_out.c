@@ -0,0 +1,325 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  audio_out.c
+ *
+ *    Description:  Sources in the output mix
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+#include <stdlib.h>
+
+#include <libavutil/samplefmt.h>
+
+#include "cuppa/errors.h"	/* error */
+#include "contrib/pa_memorybarrier.h"
+
+#include "audio_cb.h"		/* audio_cb_mix, audio_cb_ready */
+#include "audio_out.h"
+#include "counters.h"
+#include "mixer.h"
+
+/**  DATA TYPES  **************************************************************/
+
+/* Everything the callback reads is either written by the main thread before
+ * a memory barrier, or only changed between runs of the callback (which
+ * mixer_sync waits for), so neither side ever needs a lock.
+ */
+struct au_out {
+	struct mixer   *mx;	/* Mixer the source plays into */
+	struct audio   *volatile au;	/* Audio being played, or NULL */
+	struct audio   *volatile next;	/* Audio to play once 'au' ends */
+	volatile bool	running;	/* Should the callback look at 'au'? */
+	volatile bool	playing;	/* Should 'au' be played, or paused? */
+	bool		was_playing;	/* 'playing' at the last callback */
+	volatile float	gain;	/* Volume of the source in the mix */
+	struct play_counters played;	/* Kept by the callback */
+	struct decode_counters decoded;	/* Of audio since unloaded */
+};
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+/*-----------------------------------------------------------------------------
+ *  Opening and closing
+ *----------------------------------------------------------------------------*/
+
+enum error
+audio_out_open(struct au_out **out, struct mixer *mx)
+{
+	enum error	err = E_OK;
+
+	*out = calloc((size_t)1, sizeof(struct au_out));
+	if (*out == NULL)
+		err = error(E_NO_MEM, "can't alloc output structure");
+	if (err == E_OK) {
+		(*out)->mx = mx;
+		(*out)->gain = 1.0f;
+		err = mixer_add(mx, audio_cb_mix, audio_cb_ready,
+				(void *)*out);
+	}
+	return err;
+}
+
+void
+audio_out_close(struct au_out *out)
+{
+	if (out != NULL) {
+		mixer_remove(out->mx, (void *)out);
+		free(out);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+ *  Attaching audio
+ *----------------------------------------------------------------------------*/
+
+/* Attaches 'au' to the output, so that it is played once the source starts.
+ *
+ * Any previously attached audio is detached first.
+ */
+void
+audio_out_attach(struct au_out *out, struct audio *au)
+{
+	audio_out_detach(out);
+	/* Make sure the callback sees a fully set up audio structure */
+	PaUtil_WriteMemoryBarrier();
+	out->au = au;
+}
+
+/* Detaches whatever audio is attached to the output.
+ *
+ * The source is stopped first, so once this returns the callback will not
+ * touch the old audio again and it can safely be freed.  Other sources on the
+ * same stream play on regardless.
+ */
+void
+audio_out_detach(struct au_out *out)
+{
+	if (out->au != NULL) {
+		audio_out_stop(out);
+		out->playing = false;
+		out->was_playing = false;
+		out->au = NULL;
+		PaUtil_WriteMemoryBarrier();
+	}
+	audio_out_cue(out, NULL);
+}
+
+/* Returns the audio attached to the output, or NULL if there is none. */
+struct audio   *
+audio_out_attached(struct au_out *out)
+{
+	return out->au;
+}
+
+/* Cues 'au' up to be played, gaplessly, once the attached audio ends.  The
+ * cued audio should already be loaded, so its ring is full by the time it is
+ * needed, but not attached.  NULL un-cues whatever was cued.
+ *
+ * Once this returns, the callback can no longer switch to any audio that was
+ * cued before, so that can safely be freed (unless it has already been
+ * switched to; check audio_out_attached).  The callback may have picked up
+ * the old cue just before it changed, so that means waiting for it to finish
+ * its run; there's no need if it has already switched.
+ */
+void
+audio_out_cue(struct au_out *out, struct audio *au)
+{
+	struct audio   *old = out->next;
+
+	PaUtil_WriteMemoryBarrier();
+	out->next = au;
+	if (old != NULL && old != au && old != out->au)
+		mixer_sync(out->mx);
+}
+
+/* Called by the callback when the attached audio has run out for good.
+ *
+ * If there is cued audio, it becomes the attached audio and is returned.  If
+ * there isn't, NULL is returned.
+ *
+ * Only the main thread writes to 'next', so this leaves it alone; once the
+ * cued audio is attached, it no longer counts as cued.
+ */
+struct audio   *
+audio_out_hand_over(struct au_out *out)
+{
+	struct audio   *next = out->next;
+
+	PaUtil_ReadMemoryBarrier();
+	if (next == out->au)
+		next = NULL;
+	if (next != NULL)
+		out->au = next;
+	return next;
+}
+
+/*-----------------------------------------------------------------------------
+ *  Playback control
+ *----------------------------------------------------------------------------*/
+
+/* Starts the callback looking at the attached audio (which it plays only if
+ * the source is also set playing).
+ */
+enum error
+audio_out_start(struct au_out *out)
+{
+	enum error	err;
+
+	err = mixer_start(out->mx);
+	if (err == E_OK) {
+		PaUtil_WriteMemoryBarrier();
+		out->running = true;
+	}
+	return err;
+}
+
+/* Stops the source straight away, without playing out what the stream has
+ * already been given, and waits until the callback has let go of the attached
+ * audio.  Stopping a stopped source is harmless.
+ */
+enum error
+audio_out_stop(struct au_out *out)
+{
+	out->running = false;
+	mixer_sync(out->mx);
+
+	return E_OK;
+}
+
+/* Checks whether the source is running: it may have been halted by the
+ * callback, or its whole stream may have halted.
+ */
+bool
+audio_out_active(struct au_out *out)
+{
+	return out->running && mixer_active(out->mx);
+}
+
+bool
+audio_out_running(struct au_out *out)
+{
+	return out->running;
+}
+
+void
+audio_out_halt(struct au_out *out)
+{
+	out->running = false;
+}
+
+/* Pauses or unpauses the attached audio.  While paused, the source keeps
+ * running but the callback plays silence for it and leaves the audio alone.
+ */
+void
+audio_out_set_playing(struct au_out *out, bool playing)
+{
+	out->playing = playing;
+	PaUtil_WriteMemoryBarrier();
+}
+
+/* Tells the callback whether it should be playing the attached audio, and
+ * whether it has just been unpaused.
+ *
+ * Only the callback may call this, once per run.
+ */
+bool
+audio_out_playing(struct au_out *out, bool *resumed)
+{
+	bool		playing;
+
+	PaUtil_ReadMemoryBarrier();
+	playing = out->playing;
+	*resumed = (playing && !out->was_playing);
+	out->was_playing = playing;
+
+	return playing;
+}
+
+/* Changes the source's gain.  This takes effect from the callback's next run,
+ * without any smoothing, so large jumps whilst playing will click.
+ */
+void
+audio_out_set_gain(struct au_out *out, float gain)
+{
+	out->gain = gain;
+}
+
+float
+audio_out_gain(struct au_out *out)
+{
+	return out->gain;
+}
+
+/*-----------------------------------------------------------------------------
+ *  Simple accessors
+ *----------------------------------------------------------------------------*/
+
+struct play_counters *
+audio_out_play_counters(struct au_out *out)
+{
+	return &(out->played);
+}
+
+struct decode_counters *
+audio_out_decode_counters(struct au_out *out)
+{
+	return &(out->decoded);
+}
+
+double
+audio_out_sample_rate(struct au_out *out)
+{
+	return mixer_sample_rate(out->mx);
+}
+
+int
+audio_out_channels(struct au_out *out)
+{
+	return mixer_channels(out->mx);
+}
+
+enum AVSampleFormat
+audio_out_sample_fmt(struct au_out *out)
+{
+	return mixer_sample_fmt(out->mx);
+}
+
+/* Converts sample count (in samples) to stream buffer size (in bytes). */
+size_t
+audio_out_samples2bytes(struct au_out *out, size_t samples)
+{
+	return mixer_samples2bytes(out->mx, samples);
+}
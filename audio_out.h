@@ -0,0 +1,117 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  audio_out.h
+ *
+ *    Description:  Interface to output sources
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef AUDIO_OUT_H
+#define AUDIO_OUT_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+#include <stddef.h>		/* size_t */
+
+#include <libavutil/samplefmt.h>	/* enum AVSampleFormat */
+
+#include "cuppa/errors.h"	/* enum error */
+
+#include "counters.h"		/* struct play_counters, decode_counters */
+
+/**  DATA TYPES  **************************************************************/
+
+/* The audio output structure (named to match struct au_in) is one source in
+ * the mix on an output device (see mixer.h).
+ *
+ * Audio structures are attached to it to be played and detached afterwards,
+ * without touching the device or any other source playing on it.
+ *
+ * struct au_out is an opaque structure; only audio_out.c knows its true
+ * definition.
+ */
+struct au_out;
+
+/* struct audio is declared properly in audio.h. */
+struct audio;
+
+/* struct mixer is declared properly in mixer.h. */
+struct mixer;
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* Opens a new source on mixer 'mx', playing at full volume. */
+enum error	audio_out_open(struct au_out **out, struct mixer *mx);
+void		audio_out_close(struct au_out *out);
+
+/* Attaching and detaching audio to be played.  Only one audio structure may be
+ * attached at a time.
+ */
+void		audio_out_attach(struct au_out *out, struct audio *au);
+void		audio_out_detach(struct au_out *out);
+struct audio   *audio_out_attached(struct au_out *out);
+
+/* Cueing audio to follow on from the attached audio without a gap */
+void		audio_out_cue(struct au_out *out, struct audio *au);
+struct audio   *audio_out_hand_over(struct au_out *out);
+
+enum error	audio_out_start(struct au_out *out);	/* Starts source */
+enum error	audio_out_stop(struct au_out *out);	/* Stops source */
+bool		audio_out_active(struct au_out *out);	/* Source running? */
+
+/* For the callback only: is the source running, and stopping it when its
+ * audio has run out.
+ */
+bool		audio_out_running(struct au_out *out);
+void		audio_out_halt(struct au_out *out);
+
+/* Pausing; the source keeps running, but plays silence */
+void		audio_out_set_playing(struct au_out *out, bool playing);
+bool		audio_out_playing(struct au_out *out, bool *resumed);
+
+/* The source's volume in the mix, as a linear gain (1.0 being unchanged) */
+void		audio_out_set_gain(struct au_out *out, float gain);
+float		audio_out_gain(struct au_out *out);
+
+/* Health counters: those the callback keeps for the source, and those of the
+ * decoders of audio that has been unloaded from it (see audio_unload).
+ */
+struct play_counters *audio_out_play_counters(struct au_out *out);
+struct decode_counters *audio_out_decode_counters(struct au_out *out);
+
+/* The fixed properties of the stream the source plays on */
+double		audio_out_sample_rate(struct au_out *out);
+int		audio_out_channels(struct au_out *out);
+enum AVSampleFormat audio_out_sample_fmt(struct au_out *out);
+size_t		audio_out_samples2bytes(struct au_out *out, size_t samples);
+
+#endif				/* not AUDIO_OUT_H */
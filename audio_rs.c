@@ -0,0 +1,250 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  audio_rs.c
+ *
+ *    Description:  The sample rate converter
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdlib.h>
+#include <string.h>		/* memmove */
+
+#include <libavutil/avutil.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+
+#include "cuppa/errors.h"	/* dbug, error */
+
+#include "audio_rs.h"
+
+/**  DATA TYPES  **************************************************************/
+
+struct au_rs {
+	struct SwrContext *swr;	/* libswresample state */
+	int		chans;	/* Number of channels */
+	int		in_rate;	/* Rate being converted from */
+	int		out_rate;	/* Rate being converted to */
+	uint8_t       **buf;	/* Output planes, one per channel */
+	size_t		cap;	/* Samples each output plane can hold */
+	size_t		lead;	/* Output samples still to drop (see reset) */
+};
+
+/**  GLOBAL VARIABLES  ********************************************************/
+
+/* Planar, so the interleaving kernels in audio_conv get to do their thing
+ * afterwards; float, so nothing is lost on the way.
+ */
+const enum AVSampleFormat AUDIO_RS_FMT = AV_SAMPLE_FMT_FLTP;
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static enum error ensure_cap(struct au_rs *rs, size_t n);
+static void	free_buf(struct au_rs *rs);
+static void	start_over(struct au_rs *rs);
+static size_t	drop_lead(struct au_rs *rs, size_t n);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+/* The resampling itself is done by libswresample, which has properly
+ * band-limited polyphase filters and vectorised inner loops; we just keep it
+ * fed and give it somewhere to write.
+ */
+enum error
+audio_rs_init(struct au_rs **rs,
+	      enum AVSampleFormat fmt,
+	      int chans,
+	      int in_rate,
+	      int out_rate)
+{
+	int64_t		layout;
+	enum error	err = E_OK;
+
+	*rs = calloc((size_t)1, sizeof(struct au_rs));
+	if (*rs == NULL)
+		err = error(E_NO_MEM, "can't alloc resampler structure");
+	if (err == E_OK) {
+		(*rs)->chans = chans;
+		(*rs)->in_rate = in_rate;
+		(*rs)->out_rate = out_rate;
+
+		/* We never change the layout, so any will do */
+		layout = av_get_default_channel_layout(chans);
+		(*rs)->swr = swr_alloc_set_opts(NULL,
+						layout, AUDIO_RS_FMT, out_rate,
+						layout, fmt, in_rate,
+						0, NULL);
+		if ((*rs)->swr == NULL)
+			err = error(E_NO_MEM, "can't alloc resampler");
+	}
+	if (err == E_OK && swr_init((*rs)->swr) < 0)
+		err = error(E_INTERNAL_ERROR, "can't init resampler");
+	if (err == E_OK) {
+		start_over(*rs);
+		dbug("resampling %dHz to %dHz, lead-in %zu", in_rate,
+		     out_rate, (*rs)->lead);
+	}
+
+	return err;
+}
+
+void
+audio_rs_free(struct au_rs *rs)
+{
+	if (rs != NULL) {
+		swr_free(&(rs->swr));
+		free_buf(rs);
+		free(rs);
+	}
+}
+
+enum error
+audio_rs_run(struct au_rs *rs,
+	     uint8_t *const *in,
+	     size_t n,
+	     uint8_t ***out,
+	     size_t *out_n)
+{
+	int		count;
+	size_t		max;
+	enum error	err = E_OK;
+
+	/* Anything the filter is holding back, plus what these samples turn
+	 * into, rounded up.
+	 */
+	max = (size_t)swr_get_delay(rs->swr, (int64_t)rs->out_rate) +
+		((n * (size_t)rs->out_rate) / (size_t)rs->in_rate) + 1;
+	err = ensure_cap(rs, max);
+	if (err == E_OK) {
+		count = swr_convert(rs->swr,
+				    rs->buf, (int)rs->cap,
+				    (const uint8_t **)in, (int)n);
+		if (count < 0)
+			err = error(E_INTERNAL_ERROR, "resampling failed");
+	}
+	if (err == E_OK) {
+		*out = rs->buf;
+		*out_n = drop_lead(rs, (size_t)count);
+	}
+	return err;
+}
+
+void
+audio_rs_reset(struct au_rs *rs)
+{
+	/* Re-initialising a SwrContext drops its history */
+	if (swr_init(rs->swr) < 0)
+		dbug("couldn't reset resampler");
+	start_over(rs);
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* Makes sure the output buffer can hold at least 'n' samples per channel.
+ *
+ * The buffer only ever grows, and only by doubling, so after the first few
+ * frames this never allocates.
+ */
+static enum error
+ensure_cap(struct au_rs *rs, size_t n)
+{
+	size_t		cap;
+	enum error	err = E_OK;
+
+	if (n > rs->cap) {
+		for (cap = (rs->cap > 0 ? rs->cap : 1024); cap < n; cap *= 2);
+
+		free_buf(rs);
+		rs->buf = calloc((size_t)rs->chans, sizeof(uint8_t *));
+		if (rs->buf == NULL)
+			err = error(E_NO_MEM, "can't alloc resampler planes");
+		if (err == E_OK && av_samples_alloc(rs->buf, NULL, rs->chans,
+						    (int)cap, AUDIO_RS_FMT,
+						    0) < 0)
+			err = error(E_NO_MEM, "can't alloc resampler buffer");
+		if (err == E_OK)
+			rs->cap = cap;
+	}
+	return err;
+}
+
+/* Notes how far behind its input the resampler's output starts, now that it
+ * has been (re)initialised.
+ *
+ * Some versions of libswresample start their filter off to the left of the
+ * first input sample, so the first output samples are a lead-in from silence
+ * and everything after comes out late by the same amount; the delay they
+ * report before being given anything is the length of that lead-in.  Versions
+ * that line the output up with the input report nothing here.
+ */
+static void
+start_over(struct au_rs *rs)
+{
+	int64_t		delay = swr_get_delay(rs->swr, (int64_t)rs->out_rate);
+
+	rs->lead = (delay > 0 ? (size_t)delay : 0);
+}
+
+/* Throws away as much of any lead-in still owed as there is in the 'n'
+ * samples just resampled into the output planes, moving the rest down to the
+ * start; returns how many samples are left.  This only costs anything in the
+ * first frame or so after a reset.
+ */
+static size_t
+drop_lead(struct au_rs *rs, size_t n)
+{
+	int		c;
+	size_t		drop = (n < rs->lead ? n : rs->lead);
+	size_t		bps = (size_t)av_get_bytes_per_sample(AUDIO_RS_FMT);
+
+	if (drop > 0) {
+		for (c = 0; c < rs->chans; c++)
+			memmove(rs->buf[c], rs->buf[c] + (drop * bps),
+				(n - drop) * bps);
+		rs->lead -= drop;
+	}
+	return n - drop;
+}
+
+static void
+free_buf(struct au_rs *rs)
+{
+	if (rs->buf != NULL) {
+		/* av_samples_alloc makes one allocation for all planes */
+		av_freep(&(rs->buf[0]));
+		free(rs->buf);
+		rs->buf = NULL;
+	}
+	rs->cap = 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  audio_rs.h
+ *
+ *    Description:  Interface to the sample rate converter
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef AUDIO_RS_H
+#define AUDIO_RS_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stddef.h>		/* size_t */
+#include <stdint.h>		/* uint8_t */
+
+#include <libavutil/samplefmt.h>	/* enum AVSampleFormat */
+
+#include "cuppa/errors.h"	/* enum error */
+
+/**  DATA TYPES  **************************************************************/
+
+/* The resampler structure holds the state of a sample rate conversion from
+ * one rate to another, along with the buffer its output goes into.
+ *
+ * struct au_rs is an opaque structure; only audio_rs.c knows its true
+ * definition.
+ */
+struct au_rs;
+
+/**  CONSTANTS  ***************************************************************/
+
+/* The sample format resampled audio comes out in (planar float). */
+const enum AVSampleFormat AUDIO_RS_FMT;
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* Sets up resampling of 'chans'-channel audio in sample format 'fmt' from
+ * 'in_rate' Hz to 'out_rate' Hz.
+ */
+enum error
+audio_rs_init(struct au_rs **rs,
+	      enum AVSampleFormat fmt,
+	      int chans,
+	      int in_rate,
+	      int out_rate);
+void		audio_rs_free(struct au_rs *rs);
+
+/* Resamples 'n' samples from 'in' (laid out as ffmpeg frame data), pointing
+ * *out at the resampled planes and setting *out_n to how many samples they
+ * hold.  The output stays valid until the next call.
+ *
+ * The first sample out after initialising or resetting lines up with the first
+ * sample in; any lead-in the filter adds is dropped.
+ *
+ * Passing NULL for 'in' flushes out whatever the resampler is holding back.
+ */
+enum error
+audio_rs_run(struct au_rs *rs,
+	     uint8_t *const *in,
+	     size_t n,
+	     uint8_t ***out,
+	     size_t *out_n);
+
+/* Forgets all history, for example after a seek. */
+void		audio_rs_reset(struct au_rs *rs);
+
+#endif				/* not AUDIO_RS_H */
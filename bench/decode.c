@@ -0,0 +1,601 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  decode.c
+ *
+ *    Description:  Benchmark for decoding a corpus of formats
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Builds a corpus of synthetic files in each of the formats playslave is
+ * likely to meet (encoding them with ffmpeg's own encoders, the first time
+ * only), then decodes each file twice and reports how fast that went:
+ *
+ *   av    audio_av alone: open, decode and convert to 48kHz stereo float;
+ *   play  the whole playout path: audio_load on the decoder workers, feeding
+ *         the mixer of a null:fast sink.
+ *
+ * Both count samples per channel, as playslave does everywhere else, so the
+ * two rows can be compared directly.
+ *
+ * Each file is benchmarked in a child process of its own, so that the peak
+ * resident set size and the page fault count (a rough stand-in for how much
+ * memory was allocated) belong to that file alone.  Seek indexes go in an
+ * index directory next to the corpus, not the user's cache, and each file's
+ * is built before any timing starts, so that the results don't depend on
+ * whether the cache was warm.
+ *
+ * Usage: decode [SECONDS [DIR]]
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <errno.h>		/* errno, EEXIST */
+#include <math.h>		/* sin */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>	/* getrusage */
+#include <sys/stat.h>		/* mkdir, stat */
+#include <sys/types.h>
+#include <sys/wait.h>		/* waitpid */
+#include <poll.h>
+#include <time.h>		/* clock_gettime */
+#include <unistd.h>		/* fork */
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>	/* av_get_default_channel_layout */
+#include <libavutil/mathematics.h>	/* av_rescale_q */
+#include <libavutil/samplefmt.h>
+
+#include "../cuppa/errors.h"	/* enum error */
+
+#include "../audio.h"
+#include "../audio_av.h"
+#include "../audio_index.h"
+#include "../audio_out.h"
+#include "../constants.h"	/* DECODER_THREADS */
+#include "../event.h"
+#include "../mixer.h"
+#include "../workers.h"
+
+/**  MACROS  ******************************************************************/
+
+#define RATE 48000		/* Sample rate decoded to */
+#define CHANS 2			/* Channels decoded to */
+#define GEN_FRAME 1152		/* Samples per frame for encoders that don't care */
+#define PATH_LEN 256		/* Longest corpus file path */
+#define INDEX_DIR "index"	/* Seek index cache, inside the corpus */
+#define TWO_PI 6.283185307179586	/* M_PI is XSI, not C99 */
+
+/**  DATA TYPES  **************************************************************/
+
+struct corpus {
+	const char     *name;	/* File name, minus the length prefix */
+	enum AVCodecID	codec;
+	int		rate;
+	int		chans;
+	int		bit_rate;	/* Zero for lossless codecs */
+};
+
+/* What one pass over a file measured. */
+struct result {
+	double		load;	/* Seconds spent opening the file */
+	double		elapsed;	/* Seconds spent decoding it */
+	double		audio;	/* Seconds of audio that came out */
+	uint64_t	samples;	/* Samples (per channel) that came out */
+};
+
+/**  GLOBAL VARIABLES  ********************************************************/
+
+static const struct corpus CORPUS[] = {
+	{"pcm-44k-2.wav", AV_CODEC_ID_PCM_S16LE, 44100, 2, 0},
+	{"pcm-48k-1.wav", AV_CODEC_ID_PCM_S16LE, 48000, 1, 0},
+	{"flac-44k-2.flac", AV_CODEC_ID_FLAC, 44100, 2, 0},
+	{"flac-96k-2.flac", AV_CODEC_ID_FLAC, 96000, 2, 0},
+	{"mp3-44k-2.mp3", AV_CODEC_ID_MP3, 44100, 2, 192000},
+	{"mp3-22k-1.mp3", AV_CODEC_ID_MP3, 22050, 1, 64000},
+	{"aac-44k-2.m4a", AV_CODEC_ID_AAC, 44100, 2, 128000},
+	{"aac-48k-6.m4a", AV_CODEC_ID_AAC, 48000, 6, 384000},
+	{"vorbis-44k-2.ogg", AV_CODEC_ID_VORBIS, 44100, 2, 128000},
+	{NULL, AV_CODEC_ID_NONE, 0, 0, 0}
+};
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static enum error generate(const char *path, const struct corpus *c, int secs);
+static enum error encode(AVFormatContext *oc, AVStream *st, AVFrame *frame,
+			 bool *got);
+static void	synth(AVFrame *frame, enum AVSampleFormat fmt, int chans,
+		      int64_t start, int n, int rate);
+static void	put_sample(AVFrame *frame, enum AVSampleFormat fmt, int chans,
+			   int c, int i, double v);
+static enum error warm_index(const char *path);
+static int	run(const char *path, const char *name);
+static enum error bench_av(const char *path, struct result *r);
+static enum error bench_play(const char *path, struct result *r);
+static double	now(void);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+int
+main(int argc, char *argv[])
+{
+	const struct corpus *c;
+	const char     *dir = "bench/corpus";
+	char		path[PATH_LEN];
+	char		index[PATH_LEN];
+	struct stat	st;
+	int		secs = 60;
+	int		status = EXIT_SUCCESS;
+
+	if (argc > 1)
+		secs = atoi(argv[1]);
+	if (secs <= 0)
+		secs = 60;
+	if (argc > 2)
+		dir = argv[2];
+
+	av_register_all();
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+		error(E_BAD_FILE, "can't make corpus directory %s", dir);
+		return EXIT_FAILURE;
+	}
+	snprintf(index, sizeof(index), "%s/%s", dir, INDEX_DIR);
+	setenv("PLAYSLAVE_INDEX_DIR", index, 1);
+
+	for (c = CORPUS; c->name != NULL; c++) {
+		snprintf(path, sizeof(path), "%s/%ds-%s", dir, secs, c->name);
+		/* Encoders that this ffmpeg lacks just leave gaps */
+		if (stat(path, &st) != 0 && generate(path, c, secs) != E_OK)
+			continue;
+		if (warm_index(path) != E_OK ||
+		    run(path, c->name) != EXIT_SUCCESS)
+			status = EXIT_FAILURE;
+	}
+
+	return status;
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/*-----------------------------------------------------------------------------
+ *  Building the corpus
+ *----------------------------------------------------------------------------*/
+
+/* Encodes 'secs' seconds of tones and noise into 'path', as described by 'c'.
+ * A file that can't be finished is deleted, so it isn't mistaken for part of
+ * the corpus next time.
+ */
+static enum error
+generate(const char *path, const struct corpus *c, int secs)
+{
+	AVFormatContext *oc = NULL;
+	AVStream       *st = NULL;
+	AVCodecContext *cc = NULL;
+	AVCodec        *codec;
+	AVFrame        *frame = NULL;
+	uint8_t        *buf = NULL;
+	int		buf_size = 0;
+	int		frame_size = GEN_FRAME;
+	int64_t		done = 0;
+	int64_t		total = (int64_t)secs * c->rate;
+	bool		opened = false;
+	bool		header = false;
+	bool		got = true;
+	enum error	err = E_OK;
+
+	codec = avcodec_find_encoder(c->codec);
+	if (codec == NULL)
+		err = error(E_BAD_CONFIG, "no encoder for %s, skipping",
+			    c->name);
+	if (err == E_OK && avformat_alloc_output_context2(&oc, NULL, NULL,
+							  path) < 0)
+		err = error(E_BAD_CONFIG, "no muxer for %s, skipping", c->name);
+	if (err == E_OK) {
+		st = avformat_new_stream(oc, codec);
+		if (st == NULL)
+			err = error(E_NO_MEM, "can't alloc stream");
+	}
+	if (err == E_OK) {
+		cc = st->codec;
+		cc->sample_rate = c->rate;
+		cc->channels = c->chans;
+		cc->channel_layout = (uint64_t)av_get_default_channel_layout(
+								   c->chans);
+		cc->sample_fmt = (codec->sample_fmts == NULL ?
+				  AV_SAMPLE_FMT_S16 : codec->sample_fmts[0]);
+		cc->bit_rate = c->bit_rate;
+		cc->time_base = (AVRational) {
+			1, c->rate
+		};
+		/* The native AAC and Vorbis encoders are 'experimental' */
+		cc->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+		if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+			cc->flags |= CODEC_FLAG_GLOBAL_HEADER;
+		if (avcodec_open2(cc, codec, NULL) < 0)
+			err = error(E_BAD_CONFIG, "can't open encoder for %s",
+				    c->name);
+		else
+			opened = true;
+	}
+	if (err == E_OK) {
+		if (cc->frame_size > 0 && !(codec->capabilities &
+					    CODEC_CAP_VARIABLE_FRAME_SIZE))
+			frame_size = cc->frame_size;
+		buf_size = frame_size * c->chans *
+			av_get_bytes_per_sample(cc->sample_fmt);
+		buf = av_malloc((size_t)buf_size);
+		frame = avcodec_alloc_frame();
+		if (buf == NULL || frame == NULL)
+			err = error(E_NO_MEM, "can't alloc encoder frame");
+	}
+	if (err == E_OK && avio_open(&oc->pb, path, AVIO_FLAG_WRITE) < 0)
+		err = error(E_BAD_FILE, "can't create %s", path);
+	if (err == E_OK) {
+		if (avformat_write_header(oc, NULL) < 0)
+			err = error(E_BAD_FILE, "can't write header of %s",
+				    path);
+		else
+			header = true;
+	}
+
+	/* Whole frames only, so the last one may run a little long */
+	for (; err == E_OK && done < total; done += frame_size) {
+		avcodec_get_frame_defaults(frame);
+		frame->nb_samples = frame_size;
+		if (avcodec_fill_audio_frame(frame, c->chans, cc->sample_fmt,
+					     buf, buf_size, 0) < 0)
+			err = error(E_INTERNAL_ERROR, "can't fill frame");
+		if (err == E_OK) {
+			synth(frame, cc->sample_fmt, c->chans, done,
+			      frame_size, c->rate);
+			frame->pts = done;
+			err = encode(oc, st, frame, &got);
+		}
+	}
+	/* Flush out anything the encoder is holding on to */
+	while (err == E_OK && got && (codec->capabilities & CODEC_CAP_DELAY))
+		err = encode(oc, st, NULL, &got);
+
+	if (header && av_write_trailer(oc) < 0 && err == E_OK)
+		err = error(E_BAD_FILE, "can't write trailer of %s", path);
+	if (opened)
+		avcodec_close(cc);
+	if (oc != NULL) {
+		if (oc->pb != NULL)
+			avio_close(oc->pb);
+		avformat_free_context(oc);
+	}
+	av_free(frame);
+	av_free(buf);
+
+	if (err == E_OK)
+		printf("%-18s generated (%s)\n", c->name, codec->name);
+	else if (header)
+		remove(path);
+	return err;
+}
+
+/* Encodes one frame (or, if 'frame' is NULL, flushes the encoder) and writes
+ * out any packet that results.  'got' says whether there was one.
+ */
+static enum error
+encode(AVFormatContext *oc, AVStream *st, AVFrame *frame, bool *got)
+{
+	AVPacket	pkt;
+	int		got_packet = 0;
+	enum error	err = E_OK;
+
+	av_init_packet(&pkt);
+	pkt.data = NULL;
+	pkt.size = 0;
+
+	if (avcodec_encode_audio2(st->codec, &pkt, frame, &got_packet) < 0)
+		err = error(E_INTERNAL_ERROR, "encoding failed");
+	if (err == E_OK && got_packet) {
+		pkt.stream_index = st->index;
+		if (pkt.pts != (int64_t)AV_NOPTS_VALUE)
+			pkt.pts = av_rescale_q(pkt.pts, st->codec->time_base,
+					       st->time_base);
+		if (pkt.dts != (int64_t)AV_NOPTS_VALUE)
+			pkt.dts = av_rescale_q(pkt.dts, st->codec->time_base,
+					       st->time_base);
+		if (pkt.duration > 0)
+			pkt.duration = (int)av_rescale_q(pkt.duration,
+							 st->codec->time_base,
+							 st->time_base);
+		if (av_interleaved_write_frame(oc, &pkt) < 0)
+			err = error(E_BAD_FILE, "can't write packet");
+	}
+
+	*got = (err == E_OK && got_packet);
+	return err;
+}
+
+/* Fills a frame of 'n' samples, starting 'start' samples into the file, with a
+ * different tone on each channel plus a little noise, so the encoders (and
+ * later the decoders) have something realistic to chew on.
+ */
+static void
+synth(AVFrame *frame, enum AVSampleFormat fmt, int chans, int64_t start,
+      int n, int rate)
+{
+	static uint32_t	x = 2463534242u;
+	int		c;
+	int		i;
+	double		t;
+	double		v;
+
+	for (i = 0; i < n; i++) {
+		t = (double)(start + i) / rate;
+		for (c = 0; c < chans; c++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			v = 0.4 * sin(TWO_PI * 220.0 * (c + 1) * t);
+			v += 0.05 * (((double)x / 4294967296.0) - 0.5);
+			put_sample(frame, fmt, chans, c, i, v);
+		}
+	}
+}
+
+/* Stores 'v' (between -1 and 1) as sample 'i' of channel 'c', in whatever
+ * format and layout the encoder wants.
+ */
+static void
+put_sample(AVFrame *frame, enum AVSampleFormat fmt, int chans, int c, int i,
+	   double v)
+{
+	int		bps = av_get_bytes_per_sample(fmt);
+	uint8_t        *p;
+
+	if (av_sample_fmt_is_planar(fmt))
+		p = frame->extended_data[c] + (i * bps);
+	else
+		p = frame->extended_data[0] + (((i * chans) + c) * bps);
+
+	switch (av_get_packed_sample_fmt(fmt)) {
+	case AV_SAMPLE_FMT_U8:
+		*p = (uint8_t)((v * 127.0) + 128.0);
+		break;
+	case AV_SAMPLE_FMT_S16:
+		*(int16_t *)p = (int16_t)(v * 32767.0);
+		break;
+	case AV_SAMPLE_FMT_S32:
+		*(int32_t *)p = (int32_t)(v * 2147483647.0);
+		break;
+	case AV_SAMPLE_FMT_FLT:
+		*(float *)p = (float)v;
+		break;
+	case AV_SAMPLE_FMT_DBL:
+		*(double *)p = v;
+		break;
+	default:
+		break;
+	}
+}
+
+/*-----------------------------------------------------------------------------
+ *  Benchmarking
+ *----------------------------------------------------------------------------*/
+
+/* Makes sure the seek index for 'path' is in the cache, building it now if
+ * need be, so that no indexer is reading the file while it is benchmarked.
+ * The stream is picked the same way audio_av picks it.
+ */
+static enum error
+warm_index(const char *path)
+{
+	AVFormatContext *ctx = NULL;
+	struct au_index *ix = NULL;
+	int		stream = -1;
+	enum error	err = E_OK;
+
+	if (avformat_open_input(&ctx, path, NULL, NULL) < 0)
+		err = error(E_NO_FILE, "can't open %s", path);
+	if (err == E_OK && avformat_find_stream_info(ctx, NULL) < 0)
+		err = error(E_BAD_FILE, "no stream information in %s", path);
+	if (err == E_OK) {
+		stream = av_find_best_stream(ctx, AVMEDIA_TYPE_AUDIO,
+					     -1, -1, NULL, 0);
+		if (stream < 0)
+			err = error(E_BAD_FILE, "no audio stream in %s", path);
+	}
+	if (ctx != NULL)
+		avformat_close_input(&ctx);
+
+	if (err == E_OK)
+		err = audio_index_open(&ix, path, stream);
+	if (err == E_OK)
+		audio_index_wait(ix);
+	audio_index_close(ix);
+	return err;
+}
+
+/* Benchmarks one corpus file in a child process, and prints its results. */
+static int
+run(const char *path, const char *name)
+{
+	struct result	av;
+	struct result	play;
+	struct rusage	ru;
+	pid_t		pid;
+	int		status = EXIT_FAILURE;
+	enum error	err = E_OK;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		error(E_INTERNAL_ERROR, "can't fork");
+		return EXIT_FAILURE;
+	}
+	if (pid > 0) {
+		if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+			return EXIT_FAILURE;
+		return WEXITSTATUS(status);
+	}
+
+	err = bench_av(path, &av);
+	if (err == E_OK)
+		err = bench_play(path, &play);
+	if (err == E_OK && getrusage(RUSAGE_SELF, &ru) == 0) {
+		printf("%-18s av: load %6.1f ms, %7.1fx real time, "
+		       "%6.1f ns/sample\n",
+		       name, av.load * 1e3, av.audio / av.elapsed,
+		       (av.elapsed * 1e9) / (double)av.samples);
+		printf("%-18s play: load %6.1f ms, %7.1fx real time, "
+		       "%6.1f ns/sample\n",
+		       "", play.load * 1e3, play.audio / play.elapsed,
+		       (play.elapsed * 1e9) / (double)play.samples);
+		printf("%-18s peak RSS %ld KiB, %ld page faults\n",
+		       "", (long)ru.ru_maxrss, (long)ru.ru_minflt);
+	}
+	fflush(stdout);
+	_exit(err == E_OK ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/* Decodes all of 'path' with audio_av, converting to RATE Hz CHANS-channel
+ * float as a deck would.
+ */
+static enum error
+bench_av(const char *path, struct result *r)
+{
+	struct au_in   *av = NULL;
+	char           *buf = NULL;
+	char           *new_buf;
+	size_t		buf_samples = 0;
+	size_t		n;
+	double		start;
+	enum error	err;
+
+	memset(r, 0, sizeof(*r));
+
+	start = now();
+	err = audio_av_load(&av, path, AV_SAMPLE_FMT_FLT, CHANS, RATE, true,
+			    NULL);
+	r->load = now() - start;
+
+	start = now();
+	while (err == E_OK) {
+		err = audio_av_decode(av, &n);
+		if (err == E_OK && n > buf_samples) {
+			new_buf = realloc(buf, audio_av_samples2bytes(av, n));
+			if (new_buf == NULL)
+				err = error(E_NO_MEM, "can't grow buffer");
+			else {
+				buf = new_buf;
+				buf_samples = n;
+			}
+		}
+		if (err == E_OK) {
+			audio_av_convert(av, buf, 0, n);
+			r->samples += n;
+		}
+	}
+	r->elapsed = now() - start;
+	r->audio = (double)r->samples / RATE;
+
+	if (err == E_EOF)
+		err = E_OK;
+	free(buf);
+	audio_av_unload(av);
+	return err;
+}
+
+/* Plays all of 'path' into a null:fast sink, through the decoder workers and
+ * mixer, and times how long it takes to come out of the other end.
+ */
+static enum error
+bench_play(const char *path, struct result *r)
+{
+	struct mixer   *mx = NULL;
+	struct au_out  *out = NULL;
+	struct audio   *au = NULL;
+	struct pollfd	pfd;
+	double		start;
+	enum error	err;
+
+	memset(r, 0, sizeof(*r));
+
+	err = event_init();
+	if (err == E_OK)
+		err = workers_init(DECODER_THREADS);
+	if (err == E_OK)
+		err = mixer_open(&mx, "null:fast", AV_SAMPLE_FMT_FLT);
+	if (err == E_OK)
+		err = audio_out_open(&out, mx);
+
+	start = now();
+	if (err == E_OK)
+		err = audio_load(&au, path, out, NULL);
+	if (err == E_OK)
+		err = audio_prime(au);
+	r->load = now() - start;
+
+	start = now();
+	if (err == E_OK)
+		err = audio_start(au);
+	while (err == E_OK) {
+		pfd.fd = event_fd();
+		pfd.events = POLLIN;
+		poll(&pfd, 1, 100);
+		event_drain();
+		err = audio_halted(au);
+	}
+	r->elapsed = now() - start;
+
+	if (err == E_EOF) {
+		r->audio = (double)audio_usec(au) / 1e6;
+		r->samples = (uint64_t)(r->audio * RATE);
+		err = E_OK;
+	}
+	audio_unload(au);
+	audio_out_close(out);
+	mixer_close(mx);
+	workers_free();
+	event_free();
+	return err;
+}
+
+/* Returns a monotonic time in seconds. */
+static double
+now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
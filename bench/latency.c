@@ -0,0 +1,598 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  latency.c
+ *
+ *    Description:  Harness measuring command-to-audio latency
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Runs playslave against a fifo sink, sends it load, play, seek and stop over
+ * and over, and reports percentiles of how long each took: both until the
+ * OKAY (or, for load, the change to Stop) came back, and until the sink
+ * started playing the result.
+ *
+ * Usage: latency [ITERATIONS [PLAYSLAVE [MAX_MS [PERIOD]]]].  Given MAX_MS (and
+ * not 0), it fails unless play gets to the sink in under MAX_MS milliseconds
+ * 99 times out of 100, so it can stand as a test.  Given PERIOD, the sink is
+ * asked for that many samples at a time, instead of its default.
+ *
+ * The sink's times are only as fine as its period, as the samples showing a
+ * command took effect turn up a period at a time.
+ *
+ * The test file is made up here: a square wave whose level steps up every
+ * tenth of a second, so that where playback has got to can be read straight
+ * off the samples.  Output is f32, so silence is exactly zero.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <errno.h>		/* errno, EAGAIN, EINTR */
+#include <fcntl.h>		/* fcntl, open */
+#include <math.h>		/* fabsf */
+#include <poll.h>
+#include <signal.h>		/* signal, SIGPIPE */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>		/* mkfifo */
+#include <sys/types.h>
+#include <sys/wait.h>		/* waitpid */
+#include <time.h>		/* clock_gettime */
+#include <unistd.h>		/* fork, execl, pipe */
+
+#include "../cuppa/errors.h"	/* enum error */
+
+/**  MACROS  ******************************************************************/
+
+#define RATE 48000		/* Sample rate of the test file and sink */
+#define CHANS 2			/* Channels of the test file and sink */
+#define FILE_SECS 10		/* Length of the test file */
+#define STEP_SAMPLES 4800	/* Samples per level step in the test file */
+#define SQUARE_SAMPLES 24	/* Samples per half cycle of the square wave */
+#define BASE_LEVEL 1000		/* Level of the first step (of 32768) */
+#define STEP_LEVEL 100		/* Level added by each step */
+#define SEEK_SECS 5		/* Where the seek goes to */
+#define PATH_LEN 256		/* Longest temporary file path */
+#define LINE_LEN 1024		/* Longest response line */
+#define READ_SIZE 16384		/* Bytes of samples read at once */
+#define TIMEOUT_SECS 10.0	/* Longest to wait for any one command */
+
+/**  DATA TYPES  **************************************************************/
+
+/* What to listen for in the sink's output after a command. */
+enum sound {
+	SND_NONE,		/* Nothing in particular */
+	SND_AUDIBLE,		/* Any sound, after silence */
+	SND_SEEKED,		/* Audio from the seek point */
+	SND_SILENT,		/* Silence, after sound */
+};
+
+/* One command sent in each iteration, and what it is waiting for. */
+struct step {
+	const char     *name;	/* Name in the results */
+	const char     *cmd;	/* Command, with %s for the test file */
+	const char     *reply;	/* Line that means it's done */
+	enum sound	sound;	/* What it should sound like once done */
+	bool		timed;	/* Is it measured? */
+	bool		checked;	/* Is it held to MAX_MS? */
+};
+
+/* A running playslave and the ends of the pipes to it. */
+struct slave {
+	pid_t		pid;
+	FILE           *in;	/* Its stdin */
+	int		out;	/* Its stdout */
+	int		fifo;	/* Its sink */
+	char		line[LINE_LEN];	/* Partial line from 'out' */
+	size_t		line_len;
+	char		tail[sizeof(float) * CHANS];	/* Partial frame */
+	size_t		tail_len;
+};
+
+/**  GLOBAL VARIABLES  ********************************************************/
+
+static const struct step STEPS[] = {
+	{"load", "load %s", "STAT Load Stop", SND_NONE, true, false},
+	{"play", "play", "OKAY play", SND_AUDIBLE, true, true},
+	{"seek", "seek 5s", "OKAY seek 5s", SND_SEEKED, true, false},
+	{"stop", "stop", "OKAY stop", SND_SILENT, true, false},
+	{"ejct", "ejct", "OKAY ejct", SND_NONE, false, false},
+	{NULL, NULL, NULL, SND_NONE, false, false}
+};
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static enum error make_file(const char *path);
+static enum error spawn(struct slave *s, const char *prog, const char *fifo,
+		       long period);
+static void	reap(struct slave *s);
+static enum error send(struct slave *s, const struct step *st,
+		       const char *path, double *reply, double *sound);
+static enum error drain(struct slave *s, int timeout_ms, const char *reply,
+			enum sound want, bool *got_reply, bool *got_sound);
+static bool	heard(struct slave *s, const char *buf, size_t n,
+		      enum sound want);
+static double	report(const char *what, double *v, size_t n);
+static int	cmp_double(const void *a, const void *b);
+static double	now(void);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+int
+main(int argc, char *argv[])
+{
+	const struct step *st;
+	const char     *prog = "./playslave";
+	char		dir[] = "/tmp/playslave-latency.XXXXXX";
+	char		wav[PATH_LEN];
+	char		fifo[PATH_LEN];
+	char		name[LINE_LEN];
+	double         *reply[sizeof(STEPS) / sizeof(STEPS[0])];
+	double         *sound[sizeof(STEPS) / sizeof(STEPS[0])];
+	double		max_ms = 0.0;
+	double		p99;
+	long		iters = 1000;
+	long		period = 0;
+	long		i;
+	size_t		j;
+	struct slave	s;
+	enum error	err = E_OK;
+
+	if (argc > 1)
+		iters = atol(argv[1]);
+	if (iters <= 0)
+		iters = 1000;
+	if (argc > 2)
+		prog = argv[2];
+	if (argc > 3)
+		max_ms = atof(argv[3]);
+	if (argc > 4)
+		period = atol(argv[4]);
+
+	/* A playslave that dies shouldn't take us with it */
+	signal(SIGPIPE, SIG_IGN);
+	memset(&s, 0, sizeof(s));
+	memset(reply, 0, sizeof(reply));
+	memset(sound, 0, sizeof(sound));
+
+	if (mkdtemp(dir) == NULL)
+		return EXIT_FAILURE;
+	snprintf(wav, sizeof(wav), "%s/steps.wav", dir);
+	snprintf(fifo, sizeof(fifo), "%s/sink", dir);
+	/* Keep the seek index cache out of the way too */
+	setenv("PLAYSLAVE_INDEX_DIR", dir, 1);
+
+	err = make_file(wav);
+	if (err == E_OK && mkfifo(fifo, 0600) != 0)
+		err = error(E_BAD_FILE, "can't make %s", fifo);
+	for (j = 0; err == E_OK && STEPS[j].name != NULL; j++) {
+		reply[j] = calloc((size_t)iters, sizeof(double));
+		sound[j] = calloc((size_t)iters, sizeof(double));
+		if (reply[j] == NULL || sound[j] == NULL)
+			err = error(E_NO_MEM, "can't alloc results");
+	}
+	if (err == E_OK)
+		err = spawn(&s, prog, fifo, period);
+
+	for (i = 0; err == E_OK && i < iters; i++)
+		for (st = STEPS; err == E_OK && st->name != NULL; st++)
+			err = send(&s, st, wav, &reply[st - STEPS][i],
+				   &sound[st - STEPS][i]);
+
+	if (err == E_OK) {
+		if (period > 0)
+			printf("%ld iterations, period %ld\n", iters, period);
+		else
+			printf("%ld iterations, default period\n", iters);
+		printf("%-28s %8s %8s %8s %8s %8s\n",
+		       "(ms)", "p50", "p90", "p99", "p99.9", "max");
+		for (st = STEPS; st->name != NULL; st++) {
+			if (!st->timed)
+				continue;
+			j = (size_t)(st - STEPS);
+			snprintf(name, sizeof(name), "%s -> %s", st->name,
+				 st->reply);
+			report(name, reply[j], (size_t)iters);
+			if (st->sound != SND_NONE) {
+				snprintf(name, sizeof(name), "%s -> sink",
+					 st->name);
+				p99 = report(name, sound[j], (size_t)iters);
+				if (st->checked && max_ms > 0.0 &&
+				    p99 * 1e3 >= max_ms)
+					err = error(E_INTERNAL_ERROR,
+						    "%s: p99 %.2fms, over %.2fms",
+						    name, p99 * 1e3, max_ms);
+			}
+		}
+	}
+
+	reap(&s);
+	for (j = 0; STEPS[j].name != NULL; j++) {
+		free(reply[j]);
+		free(sound[j]);
+	}
+	remove(wav);
+	remove(fifo);
+	rmdir(dir);
+	return err == E_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/*-----------------------------------------------------------------------------
+ *  Setting up
+ *----------------------------------------------------------------------------*/
+
+/* Writes the test file: FILE_SECS seconds of a 16-bit stereo square wave, at
+ * BASE_LEVEL rising by STEP_LEVEL every STEP_SAMPLES.  It never touches zero,
+ * so any silence in the sink is playslave's.
+ */
+static enum error
+make_file(const char *path)
+{
+	static const unsigned char header[] = {
+		'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+		'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, CHANS, 0,
+		RATE & 0xFF, (RATE >> 8) & 0xFF, (RATE >> 16) & 0xFF, 0,
+		0, 0, 0, 0, CHANS * 2, 0, 16, 0,
+		'd', 'a', 't', 'a', 0, 0, 0, 0
+	};
+	unsigned char	h[sizeof(header)];
+	uint32_t	data = (uint32_t)FILE_SECS * RATE * CHANS * 2;
+	uint32_t	bytes_per_sec = (uint32_t)RATE * CHANS * 2;
+	unsigned char	frame[CHANS * 2];
+	int16_t		v;
+	long		i;
+	int		c;
+	FILE           *f;
+	enum error	err = E_OK;
+
+	memcpy(h, header, sizeof(h));
+	for (c = 0; c < 4; c++) {
+		h[4 + c] = (unsigned char)(((data + 36) >> (8 * c)) & 0xFF);
+		h[28 + c] = (unsigned char)((bytes_per_sec >> (8 * c)) & 0xFF);
+		h[40 + c] = (unsigned char)((data >> (8 * c)) & 0xFF);
+	}
+
+	f = fopen(path, "wb");
+	if (f == NULL)
+		return error(E_BAD_FILE, "can't create %s", path);
+	if (fwrite(h, sizeof(h), (size_t)1, f) != 1)
+		err = error(E_BAD_FILE, "can't write %s", path);
+	for (i = 0; err == E_OK && i < (long)FILE_SECS * RATE; i++) {
+		v = (int16_t)(BASE_LEVEL + (STEP_LEVEL * (i / STEP_SAMPLES)));
+		if ((i / SQUARE_SAMPLES) % 2)
+			v = (int16_t)-v;
+		for (c = 0; c < CHANS; c++) {
+			frame[c * 2] = (unsigned char)((uint16_t)v & 0xFF);
+			frame[(c * 2) + 1] = (unsigned char)((uint16_t)v >> 8);
+		}
+		if (fwrite(frame, sizeof(frame), (size_t)1, f) != 1)
+			err = error(E_BAD_FILE, "can't write %s", path);
+	}
+	if (fclose(f) != 0 && err == E_OK)
+		err = error(E_BAD_FILE, "can't write %s", path);
+	return err;
+}
+
+/* Starts playslave on a fifo sink, with a period of 'period' samples if that
+ * isn't 0, with pipes to its stdin and from its stdout, and opens our end of
+ * the fifo (which playslave waits for).
+ */
+static enum error
+spawn(struct slave *s, const char *prog, const char *fifo, long period)
+{
+	char		spec[PATH_LEN + 32];
+	int		to[2];
+	int		from[2];
+	double		start;
+	bool		ohai = false;
+	bool		ignored;
+	enum error	err = E_OK;
+
+	if (period > 0)
+		snprintf(spec, sizeof(spec), "fifo:period=%ld:%s", period, fifo);
+	else
+		snprintf(spec, sizeof(spec), "fifo:%s", fifo);
+	if (pipe(to) != 0 || pipe(from) != 0)
+		return error(E_INTERNAL_ERROR, "can't make pipes");
+
+	s->pid = fork();
+	if (s->pid < 0)
+		return error(E_INTERNAL_ERROR, "can't fork");
+	if (s->pid == 0) {
+		dup2(to[0], STDIN_FILENO);
+		dup2(from[1], STDOUT_FILENO);
+		close(to[0]);
+		close(to[1]);
+		close(from[0]);
+		close(from[1]);
+		execl(prog, prog, spec, "f32", (char *)NULL);
+		_exit(EXIT_FAILURE);
+	}
+
+	close(to[0]);
+	close(from[1]);
+	s->out = from[0];
+	s->in = fdopen(to[1], "w");
+	if (s->in == NULL)
+		err = error(E_INTERNAL_ERROR, "can't open pipe to %s", prog);
+
+	/* Without O_NONBLOCK this would wait for playslave to open its end,
+	 * forever if it never started.
+	 */
+	if (err == E_OK) {
+		s->fifo = open(fifo, O_RDONLY | O_NONBLOCK);
+		if (s->fifo < 0)
+			err = error(E_BAD_FILE, "can't open %s", fifo);
+	}
+	if (err == E_OK && fcntl(s->out, F_SETFL, O_NONBLOCK) != 0)
+		err = error(E_INTERNAL_ERROR, "can't unblock pipe");
+
+	/* Commands shouldn't be sent before OHAI, and the first load
+	 * shouldn't be charged with starting up.
+	 */
+	start = now();
+	while (err == E_OK && !ohai) {
+		err = drain(s, 100, "OHAI", SND_NONE, &ohai, &ignored);
+		if (err == E_EOF)
+			err = error(E_INTERNAL_ERROR, "%s didn't start", prog);
+		else if (err == E_OK && now() - start > TIMEOUT_SECS)
+			err = error(E_INTERNAL_ERROR, "%s didn't say OHAI",
+				    prog);
+	}
+	return err;
+}
+
+/* Tells playslave to quit, and cleans up after it. */
+static void
+reap(struct slave *s)
+{
+	bool		ignored;
+	double		start = now();
+
+	if (s->in != NULL) {
+		fputs("quit\n", s->in);
+		fclose(s->in);
+		/* Keep the sink flowing, so it can't block, until it's gone */
+		while (s->out > 0 && now() - start < TIMEOUT_SECS &&
+		       drain(s, 100, NULL, SND_NONE, &ignored,
+			     &ignored) == E_OK)
+			;
+	}
+	if (s->fifo > 0)
+		close(s->fifo);
+	if (s->out > 0)
+		close(s->out);
+	if (s->pid > 0)
+		waitpid(s->pid, NULL, 0);
+}
+
+/*-----------------------------------------------------------------------------
+ *  Measuring
+ *----------------------------------------------------------------------------*/
+
+/* Sends one step's command, then waits for its reply line and (if it has
+ * one) its sound, noting how many seconds after sending each arrived.
+ */
+static enum error
+send(struct slave *s, const struct step *st, const char *path,
+     double *reply, double *sound)
+{
+	double		sent;
+	double		t;
+	bool		got_reply = false;
+	bool		got_sound = (st->sound == SND_NONE);
+	bool		ignored;
+	enum error	err;
+
+	/* Throw away anything already played, so it can't count */
+	err = drain(s, 0, NULL, SND_NONE, &ignored, &ignored);
+
+	if (err == E_OK) {
+		fprintf(s->in, st->cmd, path);
+		fputc('\n', s->in);
+		sent = now();
+		if (fflush(s->in) != 0)
+			err = error(E_INTERNAL_ERROR, "playslave has gone");
+	}
+	while (err == E_OK && !(got_reply && got_sound)) {
+		bool		r = false;
+		bool		snd = false;
+
+		err = drain(s, 100, st->reply, st->sound, &r, &snd);
+		if (err == E_EOF)
+			err = error(E_INTERNAL_ERROR, "playslave has gone");
+		t = now() - sent;
+		if (r && !got_reply) {
+			got_reply = true;
+			*reply = t;
+		}
+		if (snd && !got_sound) {
+			got_sound = true;
+			*sound = t;
+		}
+		if (err == E_OK && t > TIMEOUT_SECS)
+			err = error(E_INTERNAL_ERROR, "%s timed out", st->name);
+	}
+	return err;
+}
+
+/* Waits up to 'timeout_ms' for output from playslave, then reads everything
+ * that is there: lines from its stdout, checked for 'reply' (and errors), and
+ * samples from its sink, checked for 'want'.  Lines only have to start with
+ * 'reply' to count.  Returns E_EOF once playslave
+ * has closed its stdout.
+ */
+static enum error
+drain(struct slave *s, int timeout_ms, const char *reply, enum sound want,
+      bool *got_reply, bool *got_sound)
+{
+	struct pollfd	pfd[2];
+	char		buf[READ_SIZE];
+	char           *nl;
+	ssize_t		n;
+	enum error	err = E_OK;
+
+	pfd[0].fd = s->out;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = s->fifo;
+	pfd[1].events = POLLIN;
+	if (poll(pfd, 2, timeout_ms) < 0 && errno != EINTR)
+		return error(E_INTERNAL_ERROR, "poll failed");
+
+	while ((n = read(s->fifo, buf, sizeof(buf))) > 0)
+		if (heard(s, buf, (size_t)n, want))
+			*got_sound = true;
+
+	while (err == E_OK &&
+	       (n = read(s->out, s->line + s->line_len,
+			 sizeof(s->line) - s->line_len - 1)) > 0) {
+		s->line_len += (size_t)n;
+		s->line[s->line_len] = '\0';
+		while ((nl = strchr(s->line, '\n')) != NULL) {
+			*nl = '\0';
+			if (reply != NULL &&
+			    strncmp(s->line, reply, strlen(reply)) == 0)
+				*got_reply = true;
+			if (strncmp(s->line, "WHAT", 4) == 0 ||
+			    strncmp(s->line, "FAIL", 4) == 0 ||
+			    strncmp(s->line, "OOPS", 4) == 0)
+				err = error(E_INTERNAL_ERROR, "playslave: %s",
+					    s->line);
+			s->line_len -= (size_t)(nl + 1 - s->line);
+			memmove(s->line, nl + 1, s->line_len + 1);
+		}
+		if (s->line_len == sizeof(s->line) - 1)
+			s->line_len = 0;	/* Too long to care about */
+	}
+	if (n == 0 && err == E_OK)
+		err = E_EOF;
+	return err;
+}
+
+/* Checks 'n' bytes of samples from the sink for the sound wanted, carrying
+ * any partial frame over to the next call.
+ */
+static bool
+heard(struct slave *s, const char *buf, size_t n, enum sound want)
+{
+	float		frame[CHANS];
+	float		level;
+	float		seeked;
+	size_t		take;
+	int		c;
+	bool		found = false;
+
+	/* Playback can't have got halfway to the seek point before the seek,
+	 * so anything louder than that came from after it (even part way
+	 * through the fade-in).
+	 */
+	seeked = (float)(BASE_LEVEL + (STEP_LEVEL * (SEEK_SECS * RATE /
+						     STEP_SAMPLES / 2)))
+		/ 32768.0f;
+
+	/* Every frame is looked at, even after a find, to keep in step */
+	while (n > 0) {
+		take = sizeof(s->tail) - s->tail_len;
+		if (take > n)
+			take = n;
+		memcpy(s->tail + s->tail_len, buf, take);
+		s->tail_len += take;
+		buf += take;
+		n -= take;
+		if (s->tail_len < sizeof(s->tail))
+			break;
+
+		s->tail_len = 0;
+		memcpy(frame, s->tail, sizeof(frame));
+		level = 0.0f;
+		for (c = 0; c < CHANS; c++)
+			if (fabsf(frame[c]) > level)
+				level = fabsf(frame[c]);
+
+		found = found ||
+			((want == SND_AUDIBLE && level > 0.0f) ||
+			 (want == SND_SEEKED && level > seeked) ||
+			 (want == SND_SILENT && level == 0.0f));
+	}
+	return found;
+}
+
+/*-----------------------------------------------------------------------------
+ *  Reporting
+ *----------------------------------------------------------------------------*/
+
+/* Prints percentiles of the 'n' times (in seconds) in 'v', in milliseconds,
+ * and returns the 99th.
+ */
+static double
+report(const char *what, double *v, size_t n)
+{
+	static const double PCTS[] = {50.0, 90.0, 99.0, 99.9, 100.0};
+	size_t		i;
+	size_t		k;
+	double		p99 = 0.0;
+
+	qsort(v, n, sizeof(double), cmp_double);
+	printf("%-28s", what);
+	for (i = 0; i < sizeof(PCTS) / sizeof(PCTS[0]); i++) {
+		k = (size_t)((PCTS[i] / 100.0) * (double)(n - 1) + 0.5);
+		printf(" %8.2f", v[k] * 1e3);
+		if (PCTS[i] == 99.0)
+			p99 = v[k];
+	}
+	printf("\n");
+	return p99;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double		x = *(const double *)a;
+	double		y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Returns a monotonic time in seconds. */
+static double
+now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
@@ -0,0 +1,190 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  resample.c
+ *
+ *    Description:  Benchmark for the sample rate converter
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Feeds a few seconds of noise through audio_rs at the common rate pairs, in
+ * frame-sized lumps like the decoder would, and reports how long it took per
+ * second of one channel's audio.  Usage: resample [SECONDS]
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>		/* clock_gettime */
+
+#include <libavutil/avutil.h>	/* av_freep */
+#include <libavutil/samplefmt.h>
+
+#include "../cuppa/errors.h"	/* enum error */
+
+#include "../audio_rs.h"
+
+/**  MACROS  ******************************************************************/
+
+#define CHANS 2			/* Channels to resample */
+#define FRAME 1152		/* Samples per chunk (one MP3 frame) */
+
+/**  DATA TYPES  **************************************************************/
+
+struct bench {
+	int		in_rate;
+	int		out_rate;
+	enum AVSampleFormat fmt;
+};
+
+/**  GLOBAL VARIABLES  ********************************************************/
+
+static const struct bench BENCHES[] = {
+	{44100, 48000, AV_SAMPLE_FMT_FLTP},
+	{44100, 48000, AV_SAMPLE_FMT_S16P},
+	{48000, 44100, AV_SAMPLE_FMT_FLTP},
+	{22050, 48000, AV_SAMPLE_FMT_FLTP},
+	{96000, 48000, AV_SAMPLE_FMT_FLTP},
+	{0, 0, AV_SAMPLE_FMT_NONE}
+};
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static enum error run(const struct bench *b, int secs);
+static void	fill(uint8_t **planes, enum AVSampleFormat fmt, size_t n);
+static double	now(void);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+int
+main(int argc, char *argv[])
+{
+	const struct bench *b;
+	int		secs = 60;
+	enum error	err = E_OK;
+
+	if (argc > 1)
+		secs = atoi(argv[1]);
+	if (secs <= 0)
+		secs = 60;
+
+	for (b = BENCHES; err == E_OK && b->in_rate != 0; b++)
+		err = run(b, secs);
+
+	return err == E_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* Resamples 'secs' seconds of CHANS-channel audio as described by 'b', then
+ * prints the cost per channel-second.
+ */
+static enum error
+run(const struct bench *b, int secs)
+{
+	uint8_t        *planes[CHANS];
+	uint8_t       **out;
+	size_t		out_n;
+	size_t		total = 0;
+	size_t		left;
+	double		start;
+	double		elapsed;
+	struct au_rs   *rs = NULL;
+	enum error	err = E_OK;
+
+	if (av_samples_alloc(planes, NULL, CHANS, FRAME, b->fmt, 0) < 0)
+		return E_NO_MEM;
+	fill(planes, b->fmt, (size_t)FRAME);
+
+	err = audio_rs_init(&rs, b->fmt, CHANS, b->in_rate, b->out_rate);
+
+	start = now();
+	for (left = (size_t)secs * (size_t)b->in_rate;
+	     err == E_OK && left >= FRAME;
+	     left -= FRAME) {
+		err = audio_rs_run(rs, planes, (size_t)FRAME, &out, &out_n);
+		total += out_n;
+	}
+	if (err == E_OK)
+		err = audio_rs_run(rs, NULL, 0, &out, &out_n);
+	elapsed = now() - start;
+	total += out_n;
+
+	if (err == E_OK)
+		printf("%5d->%5d %s %dch: %9.0f ns per channel-second "
+		       "(%.0fx real time, %zu samples out)\n",
+		       b->in_rate, b->out_rate, av_get_sample_fmt_name(b->fmt),
+		       CHANS,
+		       (elapsed * 1e9) / ((double)secs * CHANS),
+		       (double)secs / elapsed,
+		       total);
+
+	audio_rs_free(rs);
+	av_freep(&planes[0]);
+	return err;
+}
+
+/* Fills 'n' samples of each plane with white noise, so the filters can't take
+ * any shortcuts.
+ */
+static void
+fill(uint8_t **planes, enum AVSampleFormat fmt, size_t n)
+{
+	int		c;
+	size_t		i;
+	uint32_t	x = 2463534242u;
+
+	for (c = 0; c < CHANS; c++)
+		for (i = 0; i < n; i++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			if (fmt == AV_SAMPLE_FMT_S16P)
+				((int16_t *)planes[c])[i] =
+					(int16_t)(x >> 16);
+			else
+				((float *)planes[c])[i] =
+					((float)x / 4294967296.0f) - 0.5f;
+		}
+}
+
+/* Returns a monotonic time in seconds. */
+static double
+now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
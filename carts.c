@@ -0,0 +1,393 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  carts.c
+ *
+ *    Description:  Short files decoded into memory, fired on demand
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cuppa/constants.h"	/* USECS_IN_SEC */
+#include "cuppa/errors.h"	/* dbug, error */
+#include "contrib/pa_memorybarrier.h"
+#include "contrib/pa_ringbuffer.h"
+
+#include "audio_av.h"
+#include "audio_conv.h"		/* audio_conv_sum */
+#include "carts.h"
+#include "constants.h"
+#include "loader.h"
+#include "mixer.h"
+
+/**  MACROS  ******************************************************************/
+
+#define CART_SLOTS 16		/* Number of slots on the wall */
+#define CART_VOICES 8		/* Most carts that can play at once */
+#define CART_FIRES 16		/* Most fires waiting for the callback; 2^n */
+
+/**  DATA TYPES  **************************************************************/
+
+/* A whole file's worth of samples, in the output format. */
+struct pcm {
+	char           *data;	/* The samples */
+	size_t		samples;	/* Number of samples in 'data' */
+};
+
+/* One playing of a slot, which only the callback touches. */
+struct voice {
+	int		slot;	/* Slot being played */
+	unsigned int	gen;	/* The slot's 'gens' entry when started */
+	size_t		pos;	/* Samples played so far */
+	bool		active;	/* Is this voice playing? */
+};
+
+/* The main thread fills and empties slots, and passes the slots to fire on
+ * through the 'fires' ring; the callback does everything else.  Files are
+ * decoded for the slots by loaders, off the main thread.
+ */
+struct carts {
+	struct mixer   *mx;	/* Mixer the carts play into */
+	struct pcm     *volatile slots[CART_SLOTS];	/* NULL if empty */
+	struct loader  *fills[CART_SLOTS];	/* Decodes in progress */
+	volatile unsigned int gens[CART_SLOTS];	/* Bumped for each refill */
+	struct voice	voices[CART_VOICES];	/* What's playing */
+	PaUtilRingBuffer fires;	/* Slots fired since the last run */
+	int		fire_data[CART_FIRES];	/* Memory for 'fires' */
+	volatile float	gain;	/* Volume of the carts in the mix */
+};
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static void	mix(void *v_carts, char *out, unsigned long frames);
+static void	start_voice(struct carts *carts, int slot);
+static enum error decode_all(void *v_mx, const char *path, void **result,
+			     const volatile bool *cancel);
+static enum error check_slot(int slot);
+static void	free_pcm(void *v_pcm);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+enum error
+carts_init(struct carts **carts, struct mixer *mx)
+{
+	enum error	err = E_OK;
+
+	*carts = calloc((size_t)1, sizeof(struct carts));
+	if (*carts == NULL)
+		err = error(E_NO_MEM, "can't alloc carts");
+	if (err == E_OK) {
+		(*carts)->mx = mx;
+		(*carts)->gain = 1.0f;
+		if (PaUtil_InitializeRingBuffer(&(*carts)->fires,
+						(ring_buffer_size_t)sizeof(int),
+						CART_FIRES,
+						(*carts)->fire_data) != 0)
+			err = error(E_INTERNAL_ERROR, "can't init fire ring");
+	}
+	if (err == E_OK)
+		err = mixer_add(mx, mix, NULL, (void *)*carts);
+
+	return err;
+}
+
+void
+carts_free(struct carts *carts)
+{
+	int		i;
+
+	if (carts != NULL) {
+		mixer_remove(carts->mx, (void *)carts);
+		/* The decodes only use the mixer, so can outlive the carts */
+		for (i = 0; i < CART_SLOTS; i++) {
+			loader_cancel(carts->fills[i]);
+			free_pcm(carts->slots[i]);
+		}
+		free(carts);
+	}
+}
+
+/* The old contents of the slot are taken off the wall before the new file is
+ * decoded, so firing the slot in the meantime does nothing.
+ */
+enum error
+carts_load(struct carts *carts, int slot, const char *path)
+{
+	struct pcm     *old;
+	enum error	err;
+
+	err = check_slot(slot);
+	if (err == E_OK && carts->fills[slot] != NULL) {
+		loader_cancel(carts->fills[slot]);
+		carts->fills[slot] = NULL;
+	}
+	if (err == E_OK && carts->slots[slot] != NULL) {
+		/* The callback stops any voices on an empty slot, so once
+		 * it has been round once, nothing is using the old samples.
+		 */
+		old = carts->slots[slot];
+		carts->slots[slot] = NULL;
+		mixer_sync(carts->mx);
+		free_pcm(old);
+	}
+	if (err == E_OK && path != NULL)
+		err = loader_start(&(carts->fills[slot]),
+				   path,
+				   decode_all,
+				   free_pcm,
+				   (void *)carts->mx);
+	return err;
+}
+
+/* mixer_sync only waits for the callback's current run, which may have read
+ * the slot before carts_load emptied it, so a voice may still be playing the
+ * old file when the new one goes in.  The slot's generation is bumped along
+ * with the new file, and the callback drops any voice started on an older
+ * generation.
+ */
+bool
+carts_finish(struct carts *carts, int *slot, enum error *err)
+{
+	int		i;
+	void           *v_pcm;
+	struct pcm     *pcm;
+	bool		found = false;
+
+	for (i = 0; !found && i < CART_SLOTS; i++)
+		if (carts->fills[i] != NULL && loader_done(carts->fills[i])) {
+			*slot = i;
+			found = true;
+		}
+	if (found) {
+		*err = loader_finish(carts->fills[*slot], &v_pcm);
+		carts->fills[*slot] = NULL;
+		pcm = (struct pcm *)v_pcm;
+		if (*err == E_OK) {
+			carts->gens[*slot]++;
+			PaUtil_WriteMemoryBarrier();
+			carts->slots[*slot] = pcm;
+			dbug("cart %d: %zu samples", *slot, pcm->samples);
+		}
+	}
+	return found;
+}
+
+enum error
+carts_fire(struct carts *carts, int slot)
+{
+	enum error	err;
+
+	err = check_slot(slot);
+	if (err == E_OK && carts->slots[slot] == NULL)
+		err = error(E_BAD_STATE, "cart %d is empty", slot);
+	if (err == E_OK &&
+	    PaUtil_WriteRingBuffer(&carts->fires, &slot, 1) != 1)
+		err = error(E_COMMAND_FAILED, "too many carts fired at once");
+
+	return err;
+}
+
+void
+carts_set_gain(struct carts *carts, float gain)
+{
+	carts->gain = gain;
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* The mixing function for the cart wall (see mixer.h).
+ *
+ * The samples are added straight from the slots into the output, so there is
+ * no copying, and nothing to wait for.
+ */
+static void
+mix(void *v_carts, char *out, unsigned long frames)
+{
+	int		i;
+	int		slot;
+	size_t		n;
+	struct pcm     *pcm;
+	struct voice   *v;
+	struct carts   *carts = (struct carts *)v_carts;
+	enum AVSampleFormat fmt = mixer_sample_fmt(carts->mx);
+	int		chans = mixer_channels(carts->mx);
+
+	/* Start anything fired since the last run */
+	while (PaUtil_ReadRingBuffer(&carts->fires, &slot, 1) == 1)
+		start_voice(carts, slot);
+
+	for (i = 0; i < CART_VOICES; i++) {
+		v = &(carts->voices[i]);
+		pcm = (v->active ? carts->slots[v->slot] : NULL);
+		PaUtil_ReadMemoryBarrier();
+		/* Samples from another file than the voice started on */
+		if (pcm != NULL && (carts->gens[v->slot] != v->gen ||
+				    v->pos >= pcm->samples))
+			pcm = NULL;
+		if (pcm == NULL)
+			v->active = false;
+		else {
+			n = pcm->samples - v->pos;
+			if (n > (size_t)frames)
+				n = (size_t)frames;
+			audio_conv_sum(fmt,
+				       chans,
+				       out,
+				       pcm->data +
+				       mixer_samples2bytes(carts->mx, v->pos),
+				       n,
+				       carts->gain);
+			v->pos += n;
+			v->active = (v->pos < pcm->samples);
+		}
+	}
+}
+
+/* Starts a voice playing 'slot' from the top.  If every voice is busy, the
+ * one that has been playing longest makes way.
+ */
+static void
+start_voice(struct carts *carts, int slot)
+{
+	int		i;
+	struct voice   *v = &(carts->voices[0]);
+
+	for (i = 1; v->active && i < CART_VOICES; i++)
+		if (!carts->voices[i].active ||
+		    carts->voices[i].pos > v->pos)
+			v = &(carts->voices[i]);
+
+	v->slot = slot;
+	v->gen = carts->gens[slot];
+	v->pos = 0;
+	v->active = true;
+}
+
+/* Decodes all of 'path', in the output format of mixer 'v_mx', into a new
+ * block of samples.  This is a load_fn (see loader.h), so runs on a loader's
+ * thread.  Files longer than MAX_CART_USECS are refused, as they'd take up too
+ * much memory (and too long to decode).
+ *
+ * Carts only ever play from the top, so don't need a seek index.
+ */
+static enum error
+decode_all(void *v_mx, const char *path, void **result,
+	   const volatile bool *cancel)
+{
+	size_t		n;
+	size_t		cap = 0;
+	size_t		max;
+	char           *data;
+	struct au_in   *av = NULL;
+	struct pcm     *pcm;
+	struct mixer   *mx = (struct mixer *)v_mx;
+	double		rate = mixer_sample_rate(mx);
+	enum error	err = E_OK;
+
+	pcm = calloc((size_t)1, sizeof(struct pcm));
+	if (pcm == NULL)
+		err = error(E_NO_MEM, "can't alloc cart");
+	if (err == E_OK)
+		err = audio_av_load(&av,
+				    path,
+				    mixer_sample_fmt(mx),
+				    mixer_channels(mx),
+				    rate,
+				    false,
+				    cancel);
+
+	max = (size_t)(((double)MAX_CART_USECS * rate) / USECS_IN_SEC);
+	while (err == E_OK) {
+		if (*cancel)
+			err = E_INCOMPLETE;
+		if (err == E_OK)
+			err = audio_av_decode(av, &n);
+		if (err == E_OK && pcm->samples + n > max)
+			err = error(E_BAD_FILE, "%s is too long for a cart",
+				    path);
+		if (err == E_OK && pcm->samples + n > cap) {
+			/* Grow geometrically, so there are few reallocs */
+			cap = (cap * 2 > pcm->samples + n ?
+			       cap * 2 : pcm->samples + n);
+			data = realloc(pcm->data, mixer_samples2bytes(mx, cap));
+			if (data == NULL)
+				err = error(E_NO_MEM, "can't grow cart");
+			else
+				pcm->data = data;
+		}
+		if (err == E_OK) {
+			audio_av_convert(av,
+					 pcm->data +
+					 mixer_samples2bytes(mx, pcm->samples),
+					 0,
+					 n);
+			pcm->samples += n;
+		}
+	}
+	if (err == E_EOF)
+		err = E_OK;
+
+	audio_av_unload(av);
+	if (err != E_OK) {
+		free_pcm(pcm);
+		pcm = NULL;
+	}
+	*result = (void *)pcm;
+	return err;
+}
+
+static enum error
+check_slot(int slot)
+{
+	enum error	err = E_OK;
+
+	if (slot < 0 || slot >= CART_SLOTS)
+		err = error(E_BAD_COMMAND, "no such cart");
+
+	return err;
+}
+
+static void
+free_pcm(void *v_pcm)
+{
+	struct pcm     *pcm = (struct pcm *)v_pcm;
+
+	if (pcm != NULL) {
+		free(pcm->data);
+		free(pcm);
+	}
+}
@@ -0,0 +1,89 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  carts.h
+ *
+ *    Description:  Interface to the cart wall
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef CARTS_H
+#define CARTS_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+
+#include "cuppa/errors.h"	/* enum error */
+
+#include "mixer.h"		/* struct mixer */
+
+/**  DATA TYPES  **************************************************************/
+
+/* The cart wall is a set of numbered slots, each holding a short file (a
+ * jingle, say) decoded in full into memory, ready to be fired off at a
+ * moment's notice.  It is a source in its own right in a mixer, separate from
+ * any deck on the same device.
+ *
+ * Firing a slot starts it playing from the top on the next run of the
+ * callback.  Slots can be fired again while still playing, and any number of
+ * slots (up to a limit) can play at once.
+ *
+ * struct carts is an opaque structure; only carts.c knows its true
+ * definition.
+ */
+struct carts;
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* Sets up an empty cart wall, playing into mixer 'mx'. */
+enum error	carts_init(struct carts **carts, struct mixer *mx);
+void		carts_free(struct carts *carts);
+
+/* Starts decoding the whole of 'path' into slot 'slot' in the background,
+ * emptying (and stopping) the slot straight away.  A NULL 'path' just empties
+ * the slot.  Either way, any decode already going on for the slot is
+ * cancelled.
+ */
+enum error	carts_load(struct carts *carts, int slot, const char *path);
+
+/* Puts the file from one finished decode, if there are any, into its slot.
+ * Returns true if a decode had finished, with its slot in *slot and its
+ * result in *err (the slot being left empty if that isn't E_OK).
+ */
+bool		carts_finish(struct carts *carts, int *slot, enum error *err);
+
+/* Starts slot 'slot' playing from the top, as soon as possible. */
+enum error	carts_fire(struct carts *carts, int slot);
+
+/* The cart wall's volume in the mix, as a linear gain (1.0 being unchanged) */
+void		carts_set_gain(struct carts *carts, float gain);
+
+#endif				/* not CARTS_H */
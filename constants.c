@@ -25,7 +25,21 @@
 /**  GLOBAL VARIABLES  ********************************************************/
 
 /* See constants.c for more constants (especially macro-based ones) */
-const long	LOOP_NSECS = 1000;
+const double	MAX_GAIN_DB = 24.0;
+const double	SOFT_SINK_MAX_RATE = 384000.0;
+const double	SOFT_SINK_RATE = 48000.0;
+const int	OUT_CHANNELS = 2;
+const long	SINK_POLL_NSECS = 100000;
 const size_t	BUFFER_SIZE = (size_t)FF_MIN_BUFFER_SIZE;
-const size_t	RINGBUF_SIZE = (size_t)(1 << 16);
+const size_t	DECODE_HIGH_WATER = (size_t)(1 << 16);
+const size_t	DECODE_LOW_WATER = (size_t)(1 << 15);
+const size_t	FADE_IN_SAMPLES = 512;
+const size_t	RINGBUF_SIZE = (size_t)(1 << 17);
+const size_t	SEEK_HISTORY_SAMPLES = (size_t)(1 << 15);
+const unsigned long SINK_MAX_PERIOD_FRAMES = 16384;
+const unsigned long SINK_PERIOD_FRAMES = 256;
+const uint64_t	INDEX_INTERVAL_USECS = 500000;
+const uint64_t	INDEX_PREROLL_USECS = 100000;
+const uint64_t	MAX_CART_USECS = 60000000;
 const uint64_t	TIME_USECS = 1000000;
+const int	DECODER_THREADS = 4;
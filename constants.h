@@ -57,9 +57,23 @@
  * name second (eg by running them through sort) in both .h and .c would be nice.
  */
 
-const long	LOOP_NSECS;	/* Number of nanoseconds between main loops */
+const double	MAX_GAIN_DB;	/* Highest gain the gain command allows */
+const double	SOFT_SINK_MAX_RATE;	/* Highest rate= a soft sink takes */
+const double	SOFT_SINK_RATE;	/* Sample rate of null and file sinks */
+const int	OUT_CHANNELS;	/* Max channels in the output stream */
+const long	SINK_POLL_NSECS;	/* Fast sinks' wait for decoders */
 const size_t	BUFFER_SIZE;	/* Number of bytes in decoding buffer */
+const size_t	DECODE_HIGH_WATER;	/* Ring fill (samples) to stop decoding */
+const size_t	DECODE_LOW_WATER;	/* Ring fill (samples) to start decoding */
+const size_t	FADE_IN_SAMPLES;	/* Fade-in after seeking or resuming */
 const size_t	RINGBUF_SIZE;	/* Number of samples in ring buffer */
+const size_t	SEEK_HISTORY_SAMPLES;	/* Played samples kept in ring */
+const unsigned long SINK_MAX_PERIOD_FRAMES;	/* Longest sink period= */
+const unsigned long SINK_PERIOD_FRAMES;	/* Samples per sink call, by default */
+const uint64_t	INDEX_INTERVAL_USECS;	/* Min. spacing of seek index entries */
+const uint64_t	MAX_CART_USECS;	/* Longest file that can go in a cart */
+const uint64_t	INDEX_PREROLL_USECS;	/* Decode this far before seek targets */
 const uint64_t	TIME_USECS;	/* Number of microseconds between TIME pulses */
+const int	DECODER_THREADS;	/* Decoder workers shared by all decks */
 
 #endif				/* not CONSTANTS_H */
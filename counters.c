@@ -0,0 +1,113 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  counters.c
+ *
+ *    Description:  Lock-free pipeline health counters
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdint.h>
+#include <time.h>		/* clock_gettime */
+
+#include "contrib/pa_memorybarrier.h"
+
+#include "counters.h"
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+uint64_t
+counters_nsecs(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+/*-----------------------------------------------------------------------------
+ *  Callback side
+ *----------------------------------------------------------------------------*/
+
+/* Counts one run of the callback, which took 'nsecs' nanoseconds. */
+void
+counters_run(struct play_counters *c, uint64_t nsecs)
+{
+	c->runs++;
+	c->nsecs += nsecs;
+}
+
+/* Notes that the ring held 'fill' samples at the start of a run, starting the
+ * fill figures again first if the main thread has asked.
+ */
+void
+counters_fill(struct play_counters *c, uint64_t fill)
+{
+	unsigned int	req = c->fill_req;
+
+	if (req != c->fill_done) {
+		c->fill_runs = 0;
+		c->fill_sum = 0;
+		c->fill_min = UINT64_MAX;
+		c->fill_done = req;
+	}
+	if (c->fill_runs == 0 || fill < c->fill_min)
+		c->fill_min = fill;
+	c->fill_sum += fill;
+	PaUtil_WriteMemoryBarrier();
+	c->fill_runs++;
+}
+
+/*-----------------------------------------------------------------------------
+ *  Main thread side
+ *----------------------------------------------------------------------------*/
+
+/* Asks the callback to start the ring fill figures again on its next run. */
+void
+counters_restart_fill(struct play_counters *c)
+{
+	c->fill_req++;
+}
+
+/* Adds decoder counters 'c' onto 'sum'.  'sum' must be the main thread's
+ * own, and 'c' no longer written to, or a little behind is fine.
+ */
+void
+counters_add_decode(struct decode_counters *sum,
+		    const struct decode_counters *c)
+{
+	sum->frames += c->frames;
+	sum->samples += c->samples;
+	sum->nsecs += c->nsecs;
+}
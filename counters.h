@@ -0,0 +1,89 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  counters.h
+ *
+ *    Description:  Lock-free pipeline health counters
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdint.h>		/* uint64_t */
+
+/**  DATA TYPES  **************************************************************/
+
+/* Counters kept by a deck's source as the sink's callback plays it (see
+ * audio_cb.c).  Only the callback writes them, so it never has to lock; the
+ * main thread just reads them, and may be a run behind.
+ *
+ * The ring fill figures only cover the time since the main thread last asked
+ * for them to start again (see counters_restart_fill), so that a dip shows up
+ * in the report after it.
+ */
+struct play_counters {
+	volatile uint64_t runs;	/* Callback runs the source has been in */
+	volatile uint64_t nsecs;	/* Time spent in those runs */
+	volatile uint64_t underruns;	/* Runs where the ring ran dry */
+	volatile uint64_t lost;	/* Samples of silence played for those */
+	volatile uint64_t fill_min;	/* Least ring fill seen, in samples */
+	volatile uint64_t fill_sum;	/* Ring fills seen, added up */
+	volatile uint64_t fill_runs;	/* Number of ring fills seen */
+	volatile unsigned int fill_req;	/* Bumped to start fill figures again */
+	volatile unsigned int fill_done;	/* Last 'fill_req' seen */
+};
+
+/* Counters kept by one audio's decoder (see audio.c), which likewise is their
+ * only writer.
+ */
+struct decode_counters {
+	volatile uint64_t frames;	/* Frames decoded */
+	volatile uint64_t samples;	/* Samples in those frames */
+	volatile uint64_t nsecs;	/* Time spent decoding them */
+};
+
+/**  FUNCTIONS  ***************************************************************/
+
+uint64_t	counters_nsecs(void);	/* Monotonic clock, in nanoseconds */
+
+/* Callback side */
+void		counters_run(struct play_counters *c, uint64_t nsecs);
+void		counters_fill(struct play_counters *c, uint64_t fill);
+
+/* Main thread side */
+void		counters_restart_fill(struct play_counters *c);
+void
+counters_add_decode(struct decode_counters *sum,
+		    const struct decode_counters *c);
+
+#endif				/* not COUNTERS_H */
@@ -0,0 +1,138 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  event.c
+ *
+ *    Description:  The internal event pipe
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cuppa/errors.h"	/* error */
+
+#include "event.h"
+
+/**  GLOBAL VARIABLES  ********************************************************/
+
+/* The self-pipe: [0] is polled by the main loop, [1] is written to by
+ * anything that wants to wake it.
+ */
+static int	EVENT_PIPE[2] = {-1, -1};
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static enum error set_flags(int fd);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+enum error
+event_init(void)
+{
+	enum error	err = E_OK;
+
+	if (pipe(EVENT_PIPE) != 0)
+		err = error(E_INTERNAL_ERROR, "couldn't create event pipe");
+	if (err == E_OK)
+		err = set_flags(EVENT_PIPE[0]);
+	if (err == E_OK)
+		err = set_flags(EVENT_PIPE[1]);
+
+	return err;
+}
+
+void
+event_free(void)
+{
+	int		i;
+
+	for (i = 0; i < 2; i++) {
+		if (EVENT_PIPE[i] != -1) {
+			close(EVENT_PIPE[i]);
+			EVENT_PIPE[i] = -1;
+		}
+	}
+}
+
+int
+event_fd(void)
+{
+	return EVENT_PIPE[0];
+}
+
+/* Wakes up the main loop.
+ *
+ * This never blocks, so it is safe to call from the audio threads.  If the
+ * pipe is full, the main loop has plenty of wake-ups pending already, so the
+ * event is dropped.
+ */
+void
+event_post(void)
+{
+	char		c = 0;
+
+	if (write(EVENT_PIPE[1], &c, (size_t)1) < 0) {
+		/* Full pipe (EAGAIN) means a wake-up is pending anyway */
+	}
+}
+
+/* Reads everything out of the event pipe, so that it stops polling as
+ * readable.
+ */
+void
+event_drain(void)
+{
+	char		buf[64];
+
+	while (read(EVENT_PIPE[0], buf, sizeof(buf)) > 0);
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* Makes one end of the event pipe non-blocking and close-on-exec. */
+static enum error
+set_flags(int fd)
+{
+	enum error	err = E_OK;
+	int		fl;
+
+	fl = fcntl(fd, F_GETFL);
+	if (fl == -1 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) == -1)
+		err = error(E_INTERNAL_ERROR, "couldn't set up event pipe");
+	if (err == E_OK && fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+		err = error(E_INTERNAL_ERROR, "couldn't set up event pipe");
+
+	return err;
+}
@@ -0,0 +1,58 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  event.h
+ *
+ *    Description:  Interface to the internal event pipe
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include "cuppa/errors.h"	/* enum error */
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* The event pipe lets the audio threads wake the main loop up when something
+ * happens that it needs to react to (end of file, errors, and so on).
+ *
+ * Events carry no data; the main loop just re-examines the player state.
+ */
+enum error	event_init(void);	/* Creates the event pipe */
+void		event_free(void);	/* Destroys the event pipe */
+
+int		event_fd(void);	/* File descriptor to poll for events */
+void		event_post(void);	/* Wakes up the main loop */
+void		event_drain(void);	/* Clears all pending events */
+
+#endif				/* not EVENT_H */
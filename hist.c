@@ -0,0 +1,130 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  hist.c
+ *
+ *    Description:  Fixed-bucket lock-free latency histograms
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "contrib/pa_memorybarrier.h"
+
+#include "hist.h"
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static size_t	bucket(uint64_t value);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+void
+hist_record(struct hist *h, uint64_t value)
+{
+	h->counts[bucket(value)]++;
+	if (value > h->max)
+		h->max = value;
+	PaUtil_WriteMemoryBarrier();
+	h->n++;
+}
+
+uint64_t
+hist_percentile(const struct hist *h, double pct)
+{
+	uint64_t	n = h->n;
+	uint64_t	want;
+	uint64_t	seen = 0;
+	uint64_t	value = 0;
+	size_t		i;
+
+	PaUtil_ReadMemoryBarrier();
+	if (n > 0) {
+		/* The rank of the value wanted, counting from 1 */
+		want = (uint64_t)((pct / 100.0) * (double)n + 0.5);
+		if (want < 1)
+			want = 1;
+		for (i = 0; i < HIST_BUCKETS && seen < want; i++) {
+			seen += h->counts[i];
+			value = hist_bucket_high(i);
+		}
+		/* The top bucket's range is wider than anything in it */
+		if (value > h->max)
+			value = h->max;
+	}
+	return value;
+}
+
+uint64_t
+hist_bucket_low(size_t i)
+{
+	size_t		group = i >> HIST_SUB_BITS;
+	uint64_t	sub = (uint64_t)(i & ((1 << HIST_SUB_BITS) - 1));
+
+	return (group == 0 ? sub :
+		((UINT64_C(1) << HIST_SUB_BITS) + sub) << (group - 1));
+}
+
+uint64_t
+hist_bucket_high(size_t i)
+{
+	size_t		group = i >> HIST_SUB_BITS;
+
+	return (hist_bucket_low(i) +
+		(group == 0 ? 0 : (UINT64_C(1) << (group - 1)) - 1));
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* Works out which bucket 'value' goes in.  Values under 2^HIST_SUB_BITS each
+ * have a bucket of their own; above that, each power of two is split into
+ * 2^HIST_SUB_BITS buckets of equal width.
+ */
+static size_t
+bucket(uint64_t value)
+{
+	size_t		group = 0;
+
+	if (value >> HIST_MAX_BITS)
+		return HIST_BUCKETS - 1;
+	/* Shift out the bits below the HIST_SUB_BITS significant ones */
+	while (value >> (HIST_SUB_BITS + 1)) {
+		value >>= 1;
+		group++;
+	}
+	if (value >> HIST_SUB_BITS)
+		group++;
+
+	return ((group << HIST_SUB_BITS) +
+		(size_t)(value & ((1 << HIST_SUB_BITS) - 1)));
+}
@@ -0,0 +1,82 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  hist.h
+ *
+ *    Description:  Fixed-bucket lock-free latency histograms
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef HIST_H
+#define HIST_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stddef.h>		/* size_t */
+#include <stdint.h>		/* uint64_t */
+
+/**  MACROS  ******************************************************************/
+
+/* Values are bucketed to HIST_SUB_BITS significant bits (so to within about
+ * 3%), like HdrHistogram, up to 2^HIST_MAX_BITS (about a minute in
+ * nanoseconds); anything bigger goes in the last bucket.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_MAX_BITS 36
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+/**  DATA TYPES  **************************************************************/
+
+/* A histogram of non-negative values, such as times in nanoseconds.
+ *
+ * One thread (usually a sink's callback) records into it, without locking or
+ * allocating; any other thread may read it at any time, and sees something
+ * at most a value or so behind.
+ */
+struct hist {
+	volatile uint64_t counts[HIST_BUCKETS];	/* Values in each bucket */
+	volatile uint64_t n;	/* Values recorded */
+	volatile uint64_t max;	/* Biggest value recorded */
+};
+
+/**  FUNCTIONS  ***************************************************************/
+
+void		hist_record(struct hist *h, uint64_t value);
+
+/* The value below which 'pct' percent of the recorded values lie, to within
+ * a bucket (0 if nothing has been recorded).
+ */
+uint64_t	hist_percentile(const struct hist *h, double pct);
+
+/* The range of values counted in bucket 'i' */
+uint64_t	hist_bucket_low(size_t i);
+uint64_t	hist_bucket_high(size_t i);
+
+#endif				/* not HIST_H */
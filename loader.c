@@ -0,0 +1,206 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  loader.c
+ *
+ *    Description:  The background file loader
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <pthread.h>
+#include <stdbool.h>		/* bool */
+#include <stdlib.h>
+#include <string.h>		/* strdup */
+
+#include "cuppa/errors.h"	/* dbug, error */
+#include "contrib/pa_memorybarrier.h"
+
+#include "event.h"		/* event_post */
+#include "loader.h"
+
+/**  DATA TYPES  **************************************************************/
+
+struct loader {
+	char           *path;	/* File being loaded */
+	load_fn		load;	/* Function doing the load */
+	unload_fn	unload;	/* Function freeing 'result' */
+	void           *arg;	/* Argument for 'load' */
+	void           *result;	/* Result of the load */
+	enum error	err;	/* Error from the load */
+	pthread_t	thread;	/* Thread doing the load */
+	volatile bool	cancel;	/* Set to make the load give up */
+	volatile bool	done;	/* Set once 'result' and 'err' are ready */
+	struct loader  *next;	/* Next cancelled load waiting to be reaped */
+};
+
+/**  GLOBAL VARIABLES  ********************************************************/
+
+/* Cancelled loads whose threads may still be running.  Only the main thread
+ * touches this list.
+ */
+static struct loader *CANCELLED = NULL;
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static void    *loader_main(void *v_ld);
+static void	free_loader(struct loader *ld);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+enum error
+loader_start(struct loader **ld,
+	     const char *path,
+	     load_fn load,
+	     unload_fn unload,
+	     void *arg)
+{
+	enum error	err = E_OK;
+
+	*ld = calloc((size_t)1, sizeof(struct loader));
+	if (*ld == NULL)
+		err = error(E_NO_MEM, "can't alloc loader");
+	if (err == E_OK) {
+		(*ld)->load = load;
+		(*ld)->unload = unload;
+		(*ld)->arg = arg;
+		(*ld)->path = strdup(path);
+		if ((*ld)->path == NULL)
+			err = error(E_NO_MEM, "can't alloc loader path");
+	}
+	if (err == E_OK &&
+	    pthread_create(&(*ld)->thread, NULL, loader_main, (void *)*ld) != 0)
+		err = error(E_INTERNAL_ERROR, "can't start loader");
+	if (err != E_OK && *ld != NULL) {
+		free((*ld)->path);
+		free(*ld);
+		*ld = NULL;
+	}
+	return err;
+}
+
+bool
+loader_done(struct loader *ld)
+{
+	bool		done = ld->done;
+
+	PaUtil_ReadMemoryBarrier();
+	return done;
+}
+
+enum error
+loader_finish(struct loader *ld, void **result)
+{
+	enum error	err;
+
+	pthread_join(ld->thread, NULL);
+	err = ld->err;
+	/* A failed load may leave something half-built behind, which
+	 * free_loader will get rid of.
+	 */
+	*result = NULL;
+	if (err == E_OK) {
+		*result = ld->result;
+		ld->result = NULL;
+	}
+	free_loader(ld);
+
+	return err;
+}
+
+/* The load gets a chance to notice and bail out early, but it may be stuck in
+ * an open() or read() for a while yet, so it isn't waited for here.  Instead
+ * it goes on the cancelled list, for loader_reap to free once it is done; one
+ * that is done already (and has posted its event) is reaped straight away.
+ */
+void
+loader_cancel(struct loader *ld)
+{
+	if (ld != NULL) {
+		ld->cancel = true;
+		PaUtil_WriteMemoryBarrier();
+		dbug("cancelling load of %s", ld->path);
+		ld->next = CANCELLED;
+		CANCELLED = ld;
+		if (loader_done(ld))
+			loader_reap(false);
+	}
+}
+
+/* Each load posts an event as its thread finishes, so the main loop calls this
+ * whenever it is woken by one.  The threads of finished loads are as good as
+ * gone, so joining them doesn't block.
+ */
+void
+loader_reap(bool wait)
+{
+	struct loader **p = &CANCELLED;
+	struct loader  *ld;
+
+	while (*p != NULL) {
+		ld = *p;
+		if (wait || loader_done(ld)) {
+			*p = ld->next;
+			pthread_join(ld->thread, NULL);
+			dbug("cancelled load of %s", ld->path);
+			free_loader(ld);
+		} else
+			p = &(ld->next);
+	}
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+static void *
+loader_main(void *v_ld)
+{
+	struct loader  *ld = (struct loader *)v_ld;
+
+	ld->err = ld->load(ld->arg, ld->path, &(ld->result), &(ld->cancel));
+
+	PaUtil_WriteMemoryBarrier();
+	ld->done = true;
+	event_post();
+
+	return NULL;
+}
+
+/* Frees the loader and anything it loaded that nobody collected. */
+static void
+free_loader(struct loader *ld)
+{
+	if (ld->result != NULL)
+		ld->unload(ld->result);
+	free(ld->path);
+	free(ld);
+}
@@ -0,0 +1,102 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  loader.h
+ *
+ *    Description:  Interface to the background file loader
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef LOADER_H
+#define LOADER_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+
+#include "cuppa/errors.h"	/* enum error */
+
+/**  TYPEDEFS  ****************************************************************/
+
+/* The function a loader runs on its thread to load 'path', with whatever
+ * 'arg' it was started with, putting what it loaded in *result.  It should
+ * give up, with E_INCOMPLETE, once *cancel becomes true.
+ */
+typedef enum error (*load_fn) (void *arg,
+			       const char *path,
+			       void **result,
+			       const volatile bool *cancel);
+
+/* The function that frees whatever a load_fn loaded (which may be NULL, or
+ * half-built if the load failed), if nobody collects it.
+ */
+typedef void	(*unload_fn) (void *result);
+
+/**  DATA TYPES  **************************************************************/
+
+/* The loader structure represents one file being loaded on a thread of its
+ * own, so that slow storage doesn't hold up the main loop.
+ *
+ * struct loader is an opaque structure; only loader.c knows its true
+ * definition.
+ */
+struct loader;
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* Starts loading 'path' by running 'load' on it, with 'arg'.  The main loop is
+ * woken through the event pipe once loading is done.
+ */
+enum error
+loader_start(struct loader **ld,
+	     const char *path,
+	     load_fn load,
+	     unload_fn unload,
+	     void *arg);
+
+/* Has the load finished, successfully or not? */
+bool		loader_done(struct loader *ld);
+
+/* Collects the result of a finished load, putting what was loaded in *result
+ * (or NULL if the load failed), and frees the loader.
+ */
+enum error	loader_finish(struct loader *ld, void **result);
+
+/* Abandons a load, finished or not.  This never waits for the load to stop;
+ * the loader is freed later by loader_reap.
+ */
+void		loader_cancel(struct loader *ld);
+
+/* Frees cancelled loads that have stopped, or, if 'wait' is true, waits for
+ * every cancelled load to stop and frees the lot.
+ */
+void		loader_reap(bool wait);
+
+#endif				/* not LOADER_H */
@@ -39,6 +39,7 @@
 /**  INCLUDES  ****************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
@@ -47,13 +48,16 @@
 
 #include "cuppa/io.h"
 
-#include "constants.h"		/* LOOP_NSECS */
+#include "audio_conv.h"		/* audio_conv_out_ok */
 #include "messages.h"		/* MSG_xyz */
-#include "player.h"
+#include "rack.h"
 
 /**  STATIC PROTOTYPES  *******************************************************/
 
-static enum error device_id(PaDeviceIndex *device, int argc, char *argv[]);
+static enum error
+sink_names(char ***sinks, int *decks, int argc, char *argv[]);
+static enum error
+out_format(enum AVSampleFormat *fmt, int argc, char *argv[]);
 
 /**  PUBLIC FUNCTIONS  ********************************************************/
 
@@ -62,23 +66,32 @@ int
 main(int argc, char *argv[])
 {
 	/* TODO: cleanup */
-	PaDeviceIndex	device;
+	char          **sinks = NULL;
+	int		decks = 0;
+	enum AVSampleFormat fmt;
 	int		exit_code;
 	enum error	err = E_OK;
-	struct player  *context = NULL;
+	struct rack    *context = NULL;
 
 	if (Pa_Initialize() != (int)paNoError)
 		err = error(E_AUDIO_INIT_FAIL, "couldn't init portaudio");
 	if (err == E_OK)
-		err = device_id(&device, argc, argv);
+		err = sink_names(&sinks, &decks, argc, argv);
+	if (err == E_OK)
+		err = out_format(&fmt, argc, argv);
 	if (err == E_OK) {
 		av_register_all();
-		err = player_init(&context, device);
+		err = rack_init(&context, sinks, decks, fmt);
 	}
 	if (err == E_OK) {
-		err = player_main_loop(context);
+		err = rack_main_loop(context);
+		/* The rack owns the output streams, so must go first */
+		rack_free(context);
 		Pa_Terminate();
 	}
+	if (sinks != NULL)
+		free(sinks[0]);
+	free(sinks);
 	if (err == E_OK)
 		exit_code = EXIT_SUCCESS;
 	else
@@ -89,21 +102,22 @@ main(int argc, char *argv[])
 
 /**  STATIC FUNCTIONS  ********************************************************/
 
-/* Tries to parse the device ID. */
+/* Tries to parse the sinks (see sink.h), such as PortAudio device IDs, which
+ * are separated by commas; there is one deck per sink, and the same sink can
+ * be given more than once.  The sinks are checked when they are opened.
+ *
+ * The names all point into one copy of the argument, which is (*sinks)[0].
+ */
 static enum error
-device_id(PaDeviceIndex *device, int argc, char *argv[])
+sink_names(char ***sinks, int *decks, int argc, char *argv[])
 {
 	int		num_devices;
+	int		i;
+	char           *p;
 	enum error	err = E_OK;
 
 	num_devices = Pa_GetDeviceCount();
-	/*
-	 * Possible Improvement: This is rather dodgy code for getting the
-	 * device ID out of the command line arguments, maybe make it a bit
-	 * more robust.
-	 */
 	if (argc < 2) {
-		int		i;
 		const PaDeviceInfo *dev;
 
 		err = error(E_BAD_CONFIG, MSG_DEV_NOID);
@@ -113,10 +127,52 @@ device_id(PaDeviceIndex *device, int argc, char *argv[])
 			dev = Pa_GetDeviceInfo(i);
 			dbug("%u: %s", i, dev->name);
 		}
+		dbug("or: null[:fast], wav:[fast:]PATH, raw:[fast:]PATH, "
+		     "fifo:PATH");
+		dbug("and any may take period=N, as in 0:period=128");
+		dbug("and, but for devices, rate=N, as in null:rate=44100");
 	} else {
-		*device = (int)strtoul(argv[1], NULL, 10);
-		if (*device >= num_devices)
-			err = error(E_BAD_CONFIG, MSG_DEV_BADID);
+		*decks = 1;
+		for (p = argv[1]; *p != '\0'; p++)
+			if (*p == ',')
+				(*decks)++;
+		*sinks = calloc((size_t)*decks, sizeof(char *));
+		if (*sinks == NULL)
+			err = error(E_NO_MEM, "can't alloc sink list");
+		if (err == E_OK) {
+			p = strdup(argv[1]);
+			if (p == NULL)
+				err = error(E_NO_MEM, "can't alloc sink list");
+		}
+		for (i = 0; err == E_OK && i < *decks; i++) {
+			(*sinks)[i] = p;
+			p = strchr(p, ',');
+			if (p != NULL)
+				*(p++) = '\0';
+		}
+	}
+
+	return err;
+}
+
+/* Tries to parse the output sample format, which is the optional second
+ * argument: 'f32' (the default) for 32-bit float or 's16' for dithered 16-bit
+ * integer.
+ */
+static enum error
+out_format(enum AVSampleFormat *fmt, int argc, char *argv[])
+{
+	enum error	err = E_OK;
+
+	*fmt = AV_SAMPLE_FMT_FLT;
+	if (argc >= 3) {
+		if (strcmp(argv[2], "f32") == 0)
+			*fmt = AV_SAMPLE_FMT_FLT;
+		else if (strcmp(argv[2], "s16") == 0)
+			*fmt = AV_SAMPLE_FMT_S16;
+		else
+			*fmt = AV_SAMPLE_FMT_NONE;
+		err = audio_conv_out_ok(*fmt);
 	}
 
 	return err;
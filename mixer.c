@@ -0,0 +1,306 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  mixer.c
+ *
+ *    Description:  Sums sources into one output per sink
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+#include <stdlib.h>
+#include <string.h>		/* memset, strcmp, strdup */
+#include <time.h>		/* nanosleep */
+
+#include <libavutil/samplefmt.h>
+
+#include "cuppa/errors.h"	/* dbug, error */
+#include "contrib/pa_memorybarrier.h"
+
+#include "mixer.h"
+#include "sink.h"
+
+/**  MACROS  ******************************************************************/
+
+/* Most sources one mixer will take: a handful of decks, plus carts and beds. */
+#define MAX_SOURCES 16
+
+/**  DATA TYPES  **************************************************************/
+
+/* A slot in the mixer's source table. */
+struct source {
+	mix_fn		fn;	/* Mixes the source in */
+	ready_fn	ready;	/* Checks the source is ready; may be NULL */
+	void           *volatile src;	/* Argument to 'fn'; NULL if unused */
+};
+
+/* Only the main thread writes to 'sources', and only ever swaps one slot at a
+ * time between NULL and a source, so the callback can read it without
+ * locking; mixer_sync tells the main thread when the callback has moved on.
+ */
+struct mixer {
+	struct sink    *sink;	/* Where the mix goes */
+	char           *name;	/* Sink description it was opened with */
+	enum AVSampleFormat fmt;	/* Sample format of the mix */
+	struct source	sources[MAX_SOURCES];	/* Sources being mixed */
+	volatile unsigned long runs;	/* Callback runs finished so far */
+};
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static void	mix_cb(void *v_mx, char *out, unsigned long frames);
+static bool	mix_ready(void *v_mx, unsigned long frames);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+/*-----------------------------------------------------------------------------
+ *  Opening and closing
+ *----------------------------------------------------------------------------*/
+
+enum error
+mixer_open(struct mixer **mx,
+	   const char *sink,
+	   enum AVSampleFormat fmt)
+{
+	enum error	err = E_OK;
+
+	*mx = calloc((size_t)1, sizeof(struct mixer));
+	if (*mx == NULL)
+		err = error(E_NO_MEM, "can't alloc mixer");
+	if (err == E_OK) {
+		(*mx)->fmt = fmt;
+		(*mx)->name = strdup(sink);
+		if ((*mx)->name == NULL)
+			err = error(E_NO_MEM, "can't alloc mixer name");
+	}
+	if (err == E_OK)
+		err = sink_open(&((*mx)->sink), sink, fmt,
+				mix_cb, mix_ready, (void *)*mx);
+	if (err == E_OK)
+		err = mixer_start(*mx);
+
+	return err;
+}
+
+/* Closes the sink.  All sources should have been removed already. */
+void
+mixer_close(struct mixer *mx)
+{
+	if (mx != NULL) {
+		sink_close(mx->sink);
+		free(mx->name);
+		free(mx);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+ *  Sources
+ *----------------------------------------------------------------------------*/
+
+/* Adds 'src' to the mix, to be mixed in by 'fn' from the callback's next run
+ * onwards.
+ */
+enum error
+mixer_add(struct mixer *mx, mix_fn fn, ready_fn ready, void *src)
+{
+	int		i;
+	enum error	err = E_INCOMPLETE;
+
+	for (i = 0; err != E_OK && i < MAX_SOURCES; i++) {
+		if (mx->sources[i].src == NULL) {
+			mx->sources[i].fn = fn;
+			mx->sources[i].ready = ready;
+			/* Make sure the callback sees a fully set up slot */
+			PaUtil_WriteMemoryBarrier();
+			mx->sources[i].src = src;
+			err = E_OK;
+		}
+	}
+	if (err != E_OK)
+		err = error(E_BAD_CONFIG, "too many sources on device");
+
+	return err;
+}
+
+/* Takes 'src' out of the mix.  Removing a source that isn't there is
+ * harmless.
+ */
+void
+mixer_remove(struct mixer *mx, void *src)
+{
+	int		i;
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		if (mx->sources[i].src == src) {
+			mx->sources[i].src = NULL;
+			mixer_sync(mx);
+		}
+	}
+}
+
+/* The callback counts its runs as it finishes them, so a change in the count
+ * means any run that might have seen the old state is over.  A sink that
+ * isn't running has no runs to wait for.
+ */
+void
+mixer_sync(struct mixer *mx)
+{
+	unsigned long	runs;
+	struct timespec	t;
+
+	t.tv_sec = 0;
+	t.tv_nsec = 1000000;
+
+	PaUtil_FullMemoryBarrier();
+	runs = mx->runs;
+	while (mx->runs == runs && mixer_active(mx))
+		nanosleep(&t, NULL);
+}
+
+/*-----------------------------------------------------------------------------
+ *  Sink control
+ *----------------------------------------------------------------------------*/
+
+/* The sink is started when the mixer is opened and only stops if something
+ * goes badly wrong, in which case this tries to get it going again.
+ */
+enum error
+mixer_start(struct mixer *mx)
+{
+	return sink_start(mx->sink);
+}
+
+bool
+mixer_active(struct mixer *mx)
+{
+	return sink_active(mx->sink);
+}
+
+uint64_t
+mixer_underflows(struct mixer *mx)
+{
+	return sink_underflows(mx->sink);
+}
+
+const struct hist *
+mixer_hist(struct mixer *mx, enum sink_hist which)
+{
+	return sink_hist(mx->sink, which);
+}
+
+/*-----------------------------------------------------------------------------
+ *  Simple accessors
+ *----------------------------------------------------------------------------*/
+
+const char     *
+mixer_name(struct mixer *mx)
+{
+	return mx->name;
+}
+
+double
+mixer_sample_rate(struct mixer *mx)
+{
+	return sink_sample_rate(mx->sink);
+}
+
+int
+mixer_channels(struct mixer *mx)
+{
+	return sink_channels(mx->sink);
+}
+
+enum AVSampleFormat
+mixer_sample_fmt(struct mixer *mx)
+{
+	return mx->fmt;
+}
+
+/* Converts sample count (in samples) to stream buffer size (in bytes). */
+size_t
+mixer_samples2bytes(struct mixer *mx, size_t samples)
+{
+	return (samples *
+		(size_t)mixer_channels(mx) *
+		(size_t)av_get_bytes_per_sample(mx->fmt));
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* The callback proper, which the sink runs from a thread of its own (such as
+ * PortAudio's callback thread) whenever it wants more samples.
+ *
+ * It never waits on anything: sources come and go through 'sources', and
+ * everything else they need is passed through volatile flags and the rings.
+ * Sources add straight into 'out', so it starts off silent.
+ */
+static void
+mix_cb(void *v_mx, char *out, unsigned long frames)
+{
+	int		i;
+	void           *src;
+	struct mixer   *mx = (struct mixer *)v_mx;
+
+	memset(out, 0, mixer_samples2bytes(mx, (size_t)frames));
+	for (i = 0; i < MAX_SOURCES; i++) {
+		src = mx->sources[i].src;
+		PaUtil_ReadMemoryBarrier();
+		if (src != NULL)
+			mx->sources[i].fn(src, out, frames);
+	}
+
+	/* Let mixer_sync know this run is over */
+	PaUtil_FullMemoryBarrier();
+	mx->runs++;
+}
+
+/* Checks whether every source is ready for the next 'frames' samples (see
+ * sink_ready_fn).
+ */
+static bool
+mix_ready(void *v_mx, unsigned long frames)
+{
+	int		i;
+	void           *src;
+	bool		ready = true;
+	struct mixer   *mx = (struct mixer *)v_mx;
+
+	for (i = 0; ready && i < MAX_SOURCES; i++) {
+		src = mx->sources[i].src;
+		PaUtil_ReadMemoryBarrier();
+		if (src != NULL && mx->sources[i].ready != NULL)
+			ready = mx->sources[i].ready(src, frames);
+	}
+	return ready;
+}
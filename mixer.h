@@ -0,0 +1,119 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  mixer.h
+ *
+ *    Description:  Interface to the per-sink output mixer
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef MIXER_H
+#define MIXER_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+#include <stddef.h>		/* size_t */
+#include <stdint.h>		/* uint64_t */
+
+#include <libavutil/samplefmt.h>	/* enum AVSampleFormat */
+
+#include "cuppa/errors.h"	/* enum error */
+
+#include "sink.h"		/* enum sink_hist */
+
+/**  DATA TYPES  **************************************************************/
+
+/* The mixer owns the sink (see sink.h) for an output device, and sums every
+ * source added to it (decks, through struct au_out, and cart walls) into what
+ * goes to that sink.
+ *
+ * The sink is opened with a fixed sample rate, sample format and channel
+ * count, and runs from when the mixer is opened until it is closed, playing
+ * silence when no source has anything to play.
+ *
+ * struct mixer is an opaque structure; only mixer.c knows its true
+ * definition.
+ */
+struct mixer;
+
+/**  TYPEDEFS  ****************************************************************/
+
+/* A source's mixing function, run by the callback, which adds 'frames'
+ * samples of the source's audio, at whatever gain it likes, to those at 'out'.
+ *
+ * It runs in the sink's callback thread, so it MUST NOT block.
+ */
+typedef void	(*mix_fn) (void *src, char *out, unsigned long frames);
+
+/* A source's readiness check, for sinks going faster than real time (see
+ * sink_ready_fn): is 'src' ready to be mixed for the next 'frames' samples
+ * without running dry?  Also run by the callback, so MUST NOT block.
+ */
+typedef bool	(*ready_fn) (void *src, unsigned long frames);
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* Opens and starts the sink described by 'sink' (see sink.h), playing samples
+ * of format 'fmt'.
+ */
+enum error
+mixer_open(struct mixer **mx,
+	   const char *sink,
+	   enum AVSampleFormat fmt);
+void		mixer_close(struct mixer *mx);
+
+/* Adding and removing sources, each of which is mixed in by calling 'fn' on
+ * 'src' (and checked on with 'ready', which may be NULL if the source is
+ * always ready); only the main thread may do either.  Once mixer_remove
+ * returns, the callback will not touch 'src' again.
+ */
+enum error	mixer_add(struct mixer *mx, mix_fn fn, ready_fn ready,
+			  void *src);
+void		mixer_remove(struct mixer *mx, void *src);
+
+/* Waits until the callback has finished any run that was under way when this
+ * was called, so that it has seen everything written before the call.
+ */
+void		mixer_sync(struct mixer *mx);
+
+enum error	mixer_start(struct mixer *mx);	/* Restarts sink if halted */
+bool		mixer_active(struct mixer *mx);	/* Sink running? */
+uint64_t	mixer_underflows(struct mixer *mx);	/* See sink_underflows */
+const struct hist *mixer_hist(struct mixer *mx, enum sink_hist which);
+
+/* The fixed properties of the sink */
+const char     *mixer_name(struct mixer *mx);	/* Sink's description */
+double		mixer_sample_rate(struct mixer *mx);
+int		mixer_channels(struct mixer *mx);
+enum AVSampleFormat mixer_sample_fmt(struct mixer *mx);
+size_t		mixer_samples2bytes(struct mixer *mx, size_t samples);
+
+#endif				/* not MIXER_H */
@@ -38,20 +38,30 @@
 
 /**  INCLUDES  ****************************************************************/
 
-#include <stdarg.h>		/* gate_state */
+#include <inttypes.h>		/* PRIu64 */
+#include <math.h>		/* powf */
+#include <stdarg.h>		/* gate_state, extra_response */
 #include <stdbool.h>		/* bool */
 #include <stdint.h>
+#include <stdio.h>		/* snprintf, vprintf */
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>		/* struct timespec */
 
 #include "cuppa/cmd.h"		/* struct cmd, check_commands */
 #include "cuppa/io.h"           /* response */
+#include "contrib/pa_memorybarrier.h"
 
 #include "audio.h"
+#include "audio_conv.h"		/* enum xfade_curve */
+#include "audio_out.h"
+#include "carts.h"
 #include "constants.h"
-#include "messages.h"
+#include "counters.h"		/* struct play_counters, decode_counters */
+#include "hist.h"		/* hist_percentile */
+#include "loader.h"
+#include "mixer.h"
 #include "player.h"
+#include "rack.h"		/* rack_select */
 
 /**  MACROS  ******************************************************************/
 
@@ -64,11 +74,24 @@
 
 struct player {
 	struct audio   *au;	/* Audio backend structure */
+	struct mixer   *mx;	/* Mixer of the device the deck plays on */
+	struct au_out  *out;	/* Source in the mix, open for whole program */
+	struct carts   *carts;	/* Cart wall, likewise */
+	struct loader  *ld;	/* Load in progress, if any */
+	struct loader  *cue_ld;	/* Load of the cued file in progress, if any */
+	struct audio   *next;	/* Cued audio, to play once 'au' ends */
+	uint64_t	xfade_usec;	/* Crossfade from 'au' to 'next' */
+	enum xfade_curve xfade_curve;	/* Shape of that crossfade */
 
 	enum state	cstate;	/* Current state of player FSM */
-	int		device;	/* Device ID given at program start */
+
+	struct rack    *rack;	/* Rack this player is a deck in */
+	char		tag[WORD_LEN];	/* Deck number to put in responses */
 
 	uint64_t	ptime;	/* Last observed time in song */
+
+	uint64_t	cntr_nsecs;	/* Time between CNTR pulses, or 0 */
+	uint64_t	cntr_due;	/* When the next CNTR pulse is due */
 };
 
 /**  GLOBAL VARIABLES  ********************************************************/
@@ -77,6 +100,7 @@ struct player {
 const char	STATES[NUM_STATES][WORD_LEN] = {
 	"Void",
 	"Ejct",
+	"Load",
 	"Stop",
 	"Play",
 	"Quit",
@@ -84,6 +108,12 @@ const char	STATES[NUM_STATES][WORD_LEN] = {
 
 enum state	GEND = S_VOID;
 
+/* Names of the curves in enum xfade_curve, as given to xfad. */
+const char	XFADE_CURVES[NUM_XFADE_CURVES][WORD_LEN] = {
+	"lin",
+	"eqp",
+};
+
 /* Set of commands that can be performed on the player. */
 static struct cmd PLAYER_CMDS[] = {
 	/* Nullary commands */
@@ -91,9 +121,17 @@ static struct cmd PLAYER_CMDS[] = {
 	NCMD("stop", player_cmd_stop),
 	NCMD("ejct", player_cmd_ejct),
 	NCMD("quit", player_cmd_quit),
+	NCMD("hist", player_cmd_hist),
 	/* Unary commands */
 	UCMD("load", player_cmd_load),
+	UCMD("next", player_cmd_next),
 	UCMD("seek", player_cmd_seek),
+	UCMD("xfad", player_cmd_xfad),
+	UCMD("gain", player_cmd_gain),
+	UCMD("cart", player_cmd_cart),
+	UCMD("fire", player_cmd_fire),
+	UCMD("cntr", player_cmd_cntr),
+	UCMD("deck", player_cmd_deck),
 	END_CMDS
 };
 
@@ -101,7 +139,18 @@ static struct cmd PLAYER_CMDS[] = {
 
 static enum error gate_state(struct player *play, enum state s1,...);
 static void	set_state(struct player *play, enum state state);
-static enum error player_loop_iter(struct player *pl);
+static enum error load_audio(void *v_out, const char *path, void **result,
+			     const volatile bool *cancel);
+static void	unload_audio(void *v_au);
+static void	finish_load(struct player *pl);
+static void	finish_cue(struct player *pl);
+static void	finish_carts(struct player *pl);
+static void	uncue(struct player *pl);
+static bool	catch_up(struct player *pl);
+static void	set_xfade(struct player *pl);
+static enum error check_play(struct player *pl);
+static void	send_counters(struct player *pl);
+static void	extra_response(const char *code, const char *format,...);
 
 /**  PUBLIC FUNCTIONS  ********************************************************/
 
@@ -110,7 +159,10 @@ static enum error player_loop_iter(struct player *pl);
  *----------------------------------------------------------------------------*/
 
 enum error
-player_init(struct player **play, int device)
+player_init(struct player **play,
+	    struct mixer *mx,
+	    struct rack *rack,
+	    int deck)
 {
 	enum error	err = E_OK;
 
@@ -122,16 +174,34 @@ player_init(struct player **play, int device)
 	}
 	if (err == E_OK) {
 		(*play)->cstate = S_EJCT;
-		(*play)->device = device;
+		(*play)->xfade_curve = XF_EQUAL_POWER;
+		(*play)->rack = rack;
+		(*play)->mx = mx;
+		if (deck >= 0)
+			snprintf((*play)->tag, WORD_LEN, "%d ", deck);
 	}
+	/* The source is opened once, here, and stays in the mix so that
+	 * loading and ejecting files doesn't have to touch it.
+	 */
+	if (err == E_OK)
+		err = audio_out_open(&((*play)->out), mx);
+	if (err == E_OK)
+		err = carts_init(&((*play)->carts), mx);
 	return err;
 }
 
 void
 player_free(struct player *play)
 {
+	if (play->ld)
+		loader_cancel(play->ld);
+	uncue(play);
+	carts_free(play->carts);
+	/* What the loads built still points at the output */
+	loader_reap(true);
 	if (play->au)
 		audio_unload(play->au);
+	audio_out_close(play->out);
 	free(play);
 }
 
@@ -139,33 +209,72 @@ player_free(struct player *play)
  *  Main loop
  *----------------------------------------------------------------------------*/
 
+/* Reads and carries out one command from stdin. */
+enum error
+player_check_commands(struct player *pl)
+{
+	return check_commands((void *)pl, PLAYER_CMDS);
+}
+
+/* Performs an iteration of the player update loop. */
 enum error
-player_main_loop(struct player *pl)
+player_loop_iter(struct player *pl)
 {
-	struct timespec	t;
 	enum error	err = E_OK;
 
-	t.tv_sec = 0;
-	t.tv_nsec = LOOP_NSECS;
-
-	response(R_OHAI, "%s", MSG_OHAI);	/* Say hello */
-	while (player_state(pl) != S_QUIT) {
-		/*
-		 * Possible Improvement: separate command checking and player
-		 * updating into two threads.  Player updating is quite
-		 * intensive and thus impairs the command checking latency.
-		 * Do this if it doesn't make the code too complex.
-		 */
-		err = check_commands((void *)pl, PLAYER_CMDS);
-		/* TODO: Check to see if err was fatal */
-		player_loop_iter(pl);
-		nanosleep(&t, NULL);
+	if (pl->cstate == S_LOAD && loader_done(pl->ld))
+		finish_load(pl);
+	if (pl->cue_ld != NULL && loader_done(pl->cue_ld))
+		finish_cue(pl);
+	finish_carts(pl);
+	if (pl->cstate == S_PLAY)
+		err = check_play(pl);
+	if (pl->cstate == S_PLAY) {
+		/* Send a time pulse upstream every TIME_USECS usecs */
+		uint64_t	time = audio_usec(pl->au);
+		if (time / TIME_USECS > pl->ptime / TIME_USECS) {
+			response(R_TIME, "%s%" PRIu64, pl->tag, time);
+		}
+		pl->ptime = time;
+	}
+	if (pl->cntr_nsecs > 0 && counters_nsecs() >= pl->cntr_due) {
+		send_counters(pl);
+		pl->cntr_due += pl->cntr_nsecs;
+		/* Don't try to catch up on pulses missed while busy */
+		if (pl->cntr_due < counters_nsecs())
+			pl->cntr_due = counters_nsecs() + pl->cntr_nsecs;
 	}
-	response(R_TTFN, "%s", MSG_TTFN);	/* Wave goodbye */
-
 	return err;
 }
 
+/* Works out how long, in milliseconds, the main loop may sleep waiting for
+ * commands and events before it needs to send a TIME or CNTR pulse.
+ *
+ * Returns -1 (sleep indefinitely) if no pulses are due.
+ */
+int
+player_loop_timeout(struct player *pl)
+{
+	uint64_t	usecs;
+	uint64_t	now;
+	int		cntr;
+	int		timeout = -1;
+
+	if (pl->cstate == S_PLAY) {
+		usecs = TIME_USECS - (audio_usec(pl->au) % TIME_USECS);
+		/* Round up, so we wake just after the pulse is due */
+		timeout = (int)(usecs / 1000) + 1;
+	}
+	if (pl->cntr_nsecs > 0) {
+		now = counters_nsecs();
+		cntr = (pl->cntr_due > now ?
+			(int)((pl->cntr_due - now) / 1000000) + 1 : 0);
+		if (timeout < 0 || cntr < timeout)
+			timeout = cntr;
+	}
+	return timeout;
+}
+
 /*----------------------------------------------------------------------------
  *  Nullary commands
  *----------------------------------------------------------------------------*/
@@ -176,8 +285,13 @@ player_cmd_ejct(void *v_play)
 	enum error	err;
 	struct player  *play = (struct player *)v_play;
 
-	err = gate_state(play, S_STOP, S_PLAY, S_EJCT, GEND);
+	err = gate_state(play, S_STOP, S_PLAY, S_LOAD, S_EJCT, GEND);
 	if (err == E_OK && player_state(play) != S_EJCT) {
+		if (play->ld != NULL) {
+			loader_cancel(play->ld);
+			play->ld = NULL;
+		}
+		uncue(play);
 		if (play->au != NULL) {
 			audio_unload(play->au);
 			play->au = NULL;
@@ -217,6 +331,35 @@ player_cmd_quit(void *v_play)
 	return err;
 }
 
+/* Sends a HIST response for each of the timing histograms of the deck's
+ * device (see sink.h), giving the number of calls timed and then
+ * percentiles, in nanoseconds.  This can be sent in any state.
+ */
+enum error
+player_cmd_hist(void *v_play)
+{
+	int		which;
+	const struct hist *h;
+	struct player  *play = (struct player *)v_play;
+
+	for (which = 0; which < (int)NUM_SINK_HISTS; which++) {
+		h = mixer_hist(play->mx, (enum sink_hist)which);
+		extra_response("HIST", "%s%s n %" PRIu64 " p50 %" PRIu64
+			       " p90 %" PRIu64 " p99 %" PRIu64
+			       " p99.9 %" PRIu64 " max %" PRIu64,
+			       play->tag,
+			       sink_hist_name((enum sink_hist)which),
+			       h->n,
+			       hist_percentile(h, 50.0),
+			       hist_percentile(h, 90.0),
+			       hist_percentile(h, 99.0),
+			       hist_percentile(h, 99.9),
+			       h->max);
+	}
+
+	return E_OK;
+}
+
 enum error
 player_cmd_stop(void *v_play)
 {
@@ -236,18 +379,48 @@ player_cmd_stop(void *v_play)
  *  Unary commands
  *----------------------------------------------------------------------------*/
 
+/* Loading happens in the background (see loader.c), so this returns as soon
+ * as the load has started; the state goes from Load to Stop once the file is
+ * ready, or back to Ejct if it can't be loaded.  Loading over the top of a
+ * load in progress cancels it.
+ */
 enum error
 player_cmd_load(void *v_play, const char *filename)
 {
 	enum error	err;
 	struct player  *play = (struct player *)v_play;
 
-	err = audio_load(&(play->au), filename, play->device);
-	if (err)
-		player_cmd_ejct(v_play);
-	else {
-		dbug("loaded %s", filename);
-		set_state(play, S_STOP);
+	err = player_cmd_ejct(v_play);
+	if (err == E_OK)
+		err = loader_start(&(play->ld),
+				   filename,
+				   load_audio,
+				   unload_audio,
+				   (void *)play->out);
+	if (err == E_OK)
+		set_state(play, S_LOAD);
+
+	return err;
+}
+
+/* Cues 'filename' up to play straight after the current file, with no gap
+ * between the two.  Like load, the file is loaded in the background, and this
+ * returns straight away.  Cueing over the top of a cue replaces it.
+ */
+enum error
+player_cmd_next(void *v_play, const char *filename)
+{
+	enum error	err;
+	struct player  *play = (struct player *)v_play;
+
+	err = gate_state(play, S_STOP, S_PLAY, GEND);
+	if (err == E_OK) {
+		uncue(play);
+		err = loader_start(&(play->cue_ld),
+				   filename,
+				   load_audio,
+				   unload_audio,
+				   (void *)play->out);
 	}
 
 	return err;
@@ -258,12 +431,9 @@ player_cmd_seek(void *v_play, const char *time_str)
 {
 	uint64_t	time;
 	char           *end;
-	enum state	state;
 	enum error	err = E_OK;
 	struct player  *play = (struct player *)v_play;
 
-	state = player_state(play);
-
 	/* TODO: proper overflow checking */
 
 	time = (uint64_t)strtoull(time_str, &end, 10);
@@ -278,18 +448,161 @@ player_cmd_seek(void *v_play, const char *time_str)
 	/* Weed out any unwanted states */
 	if (err == E_OK)
 		err = gate_state(play, S_PLAY, S_STOP, GEND);
-	/* We need the player engine stopped in order to seek */
-	if (err == E_OK && state == S_PLAY)
-		err = player_cmd_stop(v_play);
+	/* This doesn't wait for the seek to happen, and playback carries on
+	 * (with a short silence) while it does.
+	 */
 	if (err == E_OK)
 		err = audio_seek_usec(play->au, time);
-	/* If we were playing before we'd ideally like to resume */
-	if (err == E_OK && state == S_PLAY)
-		err = player_cmd_play(v_play);
 
 	return err;
 }
 
+/* Sets how long, in milliseconds, to crossfade between the current file and
+ * one cued with next, optionally followed by the shape of the fade.  0 turns
+ * crossfading off (the default), leaving a gapless handover.  This sticks
+ * until changed, across files.
+ */
+enum error
+player_cmd_xfad(void *v_play, const char *arg)
+{
+	uint64_t	ms;
+	char           *end;
+	int		i;
+	enum error	err = E_OK;
+	enum xfade_curve curve;
+	struct player  *play = (struct player *)v_play;
+
+	curve = play->xfade_curve;
+	ms = (uint64_t)strtoull(arg, &end, 10);
+	if (arg == end)
+		err = error(E_BAD_COMMAND, "expecting number");
+	while (err == E_OK && *end == ' ')
+		end++;
+	if (err == E_OK && *end != '\0') {
+		err = error(E_BAD_COMMAND, "expecting lin or eqp");
+		for (i = 0; i < (int)NUM_XFADE_CURVES; i++) {
+			if (strcmp(end, XFADE_CURVES[i]) == 0) {
+				curve = (enum xfade_curve)i;
+				err = E_OK;
+			}
+		}
+	}
+	if (err == E_OK) {
+		play->xfade_usec = ms * (USECS_IN_SEC / 1000);
+		play->xfade_curve = curve;
+		set_xfade(play);
+	}
+
+	return err;
+}
+
+/* Sets the deck's volume, carts and all, in the mix on its device, in decibels
+ * (0 being unchanged).  This can be done in any state, and sticks until
+ * changed.
+ */
+enum error
+player_cmd_gain(void *v_play, const char *db_str)
+{
+	double		db;
+	float		gain;
+	char           *end;
+	enum error	err = E_OK;
+	struct player  *play = (struct player *)v_play;
+
+	db = strtod(db_str, &end);
+	if (db_str == end || *end != '\0')
+		err = error(E_BAD_COMMAND, "expecting number");
+	else if (db > MAX_GAIN_DB)
+		err = error(E_BAD_COMMAND, "gain too high");
+	if (err == E_OK) {
+		gain = powf(10.0f, (float)db / 20.0f);
+		audio_out_set_gain(play->out, gain);
+		carts_set_gain(play->carts, gain);
+	}
+
+	return err;
+}
+
+/* Decodes a file into a cart slot, given as the slot number followed by the
+ * file; just the slot number empties the slot.  This can be done in any state,
+ * and doesn't touch the file the deck is playing.  Like load, the decoding
+ * happens in the background, and a CART response is sent once the slot is
+ * filled.
+ */
+enum error
+player_cmd_cart(void *v_play, const char *arg)
+{
+	long		slot;
+	char           *end;
+	enum error	err = E_OK;
+	struct player  *play = (struct player *)v_play;
+
+	slot = strtol(arg, &end, 10);
+	if (arg == end)
+		err = error(E_BAD_COMMAND, "expecting number");
+	while (err == E_OK && *end == ' ')
+		end++;
+	if (err == E_OK)
+		err = carts_load(play->carts,
+				 (int)slot,
+				 (*end == '\0' ? NULL : end));
+
+	return err;
+}
+
+/* Fires off the cart in the given slot, over whatever else is playing. */
+enum error
+player_cmd_fire(void *v_play, const char *slot_str)
+{
+	long		slot;
+	char           *end;
+	enum error	err = E_OK;
+	struct player  *play = (struct player *)v_play;
+
+	slot = strtol(slot_str, &end, 10);
+	if (slot_str == end || *end != '\0')
+		err = error(E_BAD_COMMAND, "expecting number");
+	if (err == E_OK)
+		err = carts_fire(play->carts, (int)slot);
+
+	return err;
+}
+
+/* Sends a CNTR response with the deck's health counters straight away, and
+ * then every so many seconds (which may be fractional) if given more than 0.
+ * 0 stops the pulses.
+ */
+enum error
+player_cmd_cntr(void *v_play, const char *secs_str)
+{
+	double		secs;
+	char           *end;
+	enum error	err = E_OK;
+	struct player  *play = (struct player *)v_play;
+
+	secs = strtod(secs_str, &end);
+	if (secs_str == end || *end != '\0')
+		err = error(E_BAD_COMMAND, "expecting number");
+	else if (secs < 0.0)
+		err = error(E_BAD_COMMAND, "period can't be negative");
+	if (err == E_OK) {
+		send_counters(play);
+		play->cntr_nsecs = (uint64_t)(secs * 1e9);
+		play->cntr_due = counters_nsecs() + play->cntr_nsecs;
+	}
+
+	return err;
+}
+
+/* Sends later commands to another deck (see rack.c). */
+enum error
+player_cmd_deck(void *v_play, const char *deck)
+{
+	struct player  *play = (struct player *)v_play;
+
+	return rack_select(play->rack, deck);
+}
+
 /*----------------------------------------------------------------------------
  *  Miscellaneous
  *----------------------------------------------------------------------------*/
@@ -301,29 +614,172 @@ player_state(struct player *play)
 
 /**  STATIC FUNCTIONS  ********************************************************/
 
-/* Performs an iteration of the player update loop. */
-enum error
-player_loop_iter(struct player *pl)
+/* Checks whether the playing audio has ended, moving on to the cued audio if
+ * there is any and ejecting otherwise.
+ */
+static enum error
+check_play(struct player *pl)
 {
 	enum error	err = E_OK;
 
-	if (pl->cstate == S_PLAY) {
-		if (audio_halted(pl->au)) {
+	if (catch_up(pl))
+		set_state(pl, S_PLAY);
+	else if (audio_halted(pl->au)) {
+		if (pl->next != NULL) {
+			/* The cue came in too late for a gapless handover,
+			 * so start it up by hand instead.
+			 */
+			audio_unload(pl->au);
+			pl->au = pl->next;
+			pl->next = NULL;
+			pl->ptime = 0;
+			err = audio_prime(pl->au);
+			if (err == E_OK)
+				err = audio_start(pl->au);
+			if (err == E_OK)
+				set_state(pl, S_PLAY);
+			else
+				err = player_cmd_ejct((void *)pl);
+		} else
 			err = player_cmd_ejct((void *)pl);
-		} else {
-			/* Send a time pulse upstream every TIME_USECS usecs */
-			uint64_t	time = audio_usec(pl->au);
-			if (time / TIME_USECS > pl->ptime / TIME_USECS) {
-				response(R_TIME, "%u", time);
-			}
-			pl->ptime = time;
-		}
 	}
-	if (err == E_OK && (pl->cstate == S_PLAY || pl->cstate == S_STOP))
-		err = audio_decode(pl->au);
 	return err;
 }
 
+/* Loads a file for playing on the output 'v_out'; the load_fn (see loader.h)
+ * for the deck's loads.
+ */
+static enum error
+load_audio(void *v_out, const char *path, void **result,
+	   const volatile bool *cancel)
+{
+	struct audio   *au = NULL;
+	enum error	err;
+
+	err = audio_load(&au, path, (struct au_out *)v_out, cancel);
+	*result = (void *)au;
+	return err;
+}
+
+/* The unload_fn (see loader.h) for the deck's loads. */
+static void
+unload_audio(void *v_au)
+{
+	audio_unload((struct audio *)v_au);
+}
+
+/* Takes the result of a finished background load, and moves the player on to
+ * Stop (or back to Ejct, if it failed).
+ */
+static void
+finish_load(struct player *pl)
+{
+	void           *au;
+	enum error	err;
+
+	err = loader_finish(pl->ld, &au);
+	pl->ld = NULL;
+	pl->au = (struct audio *)au;
+	if (err == E_OK)
+		err = audio_prime(pl->au);
+	if (err == E_OK) {
+		dbug("loaded file");
+		set_state(pl, S_STOP);
+	} else {
+		if (pl->au != NULL) {
+			audio_unload(pl->au);
+			pl->au = NULL;
+		}
+		set_state(pl, S_EJCT);
+	}
+}
+
+/* Takes the result of a finished background load of a cued file, and hands it
+ * to the output to follow on from the current file.
+ */
+static void
+finish_cue(struct player *pl)
+{
+	void           *au;
+	enum error	err;
+
+	err = loader_finish(pl->cue_ld, &au);
+	pl->cue_ld = NULL;
+	pl->next = (struct audio *)au;
+	if (err == E_OK) {
+		dbug("cued file");
+		audio_out_cue(pl->out, pl->next);
+		set_xfade(pl);
+	}
+}
+
+/* Puts the files from any finished cart decodes into their slots, and says
+ * which slots are now ready to fire.  Decodes that failed have already said
+ * why.
+ */
+static void
+finish_carts(struct player *pl)
+{
+	int		slot;
+	enum error	err;
+
+	while (carts_finish(pl->carts, &slot, &err))
+		if (err == E_OK)
+			extra_response("CART", "%s%d", pl->tag, slot);
+}
+
+/* Cancels any cue, whether still loading or ready to go. */
+static void
+uncue(struct player *pl)
+{
+	if (pl->cue_ld != NULL) {
+		loader_cancel(pl->cue_ld);
+		pl->cue_ld = NULL;
+	}
+	if (pl->next != NULL) {
+		/* Make sure the callback can't switch to it mid-unload */
+		audio_out_cue(pl->out, NULL);
+		if (!catch_up(pl)) {
+			audio_crossfade(pl->au, NULL, 0, pl->xfade_curve);
+			audio_unload(pl->next);
+			pl->next = NULL;
+		}
+	}
+}
+
+/* Catches up with the callback, if it has handed over from the current audio
+ * to the cued audio (which it does without a gap, and without waiting for us),
+ * by freeing the old audio and making the cued audio current.
+ *
+ * Returns true if there was a handover to catch up with.
+ */
+static bool
+catch_up(struct player *pl)
+{
+	bool		handed_over;
+
+	handed_over = (pl->next != NULL &&
+		       audio_out_attached(pl->out) == pl->next);
+	if (handed_over) {
+		audio_unload(pl->au);
+		pl->au = pl->next;
+		pl->next = NULL;
+		pl->ptime = 0;
+		dbug("handed over to cued file");
+	}
+	return handed_over;
+}
+
+/* Passes the crossfade settings on to the current audio, if there is a file
+ * cued up to fade into.
+ */
+static void
+set_xfade(struct player *pl)
+{
+	if (pl->au != NULL && pl->next != NULL)
+		audio_crossfade(pl->au, pl->next,
+				pl->xfade_usec, pl->xfade_curve);
+}
 
 /* Throws an error if the current state is not in the state set provided by
  * argument s1 and subsequent arguments up to 'GEND'.
@@ -369,6 +825,79 @@ gate_state(struct player *play, enum state s1,...)
 	return err;
 }
 
+/* Sends a CNTR response with the deck's health counters:
+ *
+ *   runs      callback runs the deck's source has been in;
+ *   cb_ns     average nanoseconds spent in each;
+ *   underruns runs where the ring ran dry while playing;
+ *   lost      samples of silence played because of that;
+ *   xruns     times the device ran dry (shared by decks on the device);
+ *   fill_min  least, and
+ *   fill_avg  average, samples left in the ring at each run since the last
+ *             CNTR (both 0 if there haven't been any);
+ *   frames    frames decoded, by all the deck's files so far;
+ *   samples   samples in those frames;
+ *   dec_ns    average nanoseconds spent decoding each frame.
+ *
+ * Apart from the fill figures, these count up from when the deck started.
+ */
+static void
+send_counters(struct player *pl)
+{
+	uint64_t	fill_min = 0;
+	uint64_t	fill_avg = 0;
+	uint64_t	fill_runs;
+	struct play_counters *p = audio_out_play_counters(pl->out);
+	struct decode_counters d = *audio_out_decode_counters(pl->out);
+
+	if (pl->au != NULL)
+		counters_add_decode(&d, audio_decode_counters(pl->au));
+	if (pl->next != NULL)
+		counters_add_decode(&d, audio_decode_counters(pl->next));
+
+	fill_runs = p->fill_runs;
+	PaUtil_ReadMemoryBarrier();
+	if (fill_runs > 0 && p->fill_done == p->fill_req) {
+		fill_min = p->fill_min;
+		fill_avg = p->fill_sum / fill_runs;
+	}
+	counters_restart_fill(p);
+
+	extra_response("CNTR", "%sruns %" PRIu64 " cb_ns %" PRIu64
+		       " underruns %" PRIu64 " lost %" PRIu64
+		       " xruns %" PRIu64
+		       " fill_min %" PRIu64 " fill_avg %" PRIu64
+		       " frames %" PRIu64 " samples %" PRIu64
+		       " dec_ns %" PRIu64,
+		       pl->tag,
+		       p->runs,
+		       (p->runs > 0 ? p->nsecs / p->runs : 0),
+		       p->underruns,
+		       p->lost,
+		       mixer_underflows(pl->mx),
+		       fill_min,
+		       fill_avg,
+		       d.frames,
+		       d.samples,
+		       (d.frames > 0 ? d.nsecs / d.frames : 0));
+}
+
+/* Sends a response with a code cuppa's response() doesn't know about, in the
+ * same form: code, space, then the rest, on a line of its own.
+ */
+static void
+extra_response(const char *code, const char *format,...)
+{
+	va_list		ap;
+
+	printf("%s ", code);
+	va_start(ap, format);
+	vprintf(format, ap);
+	va_end(ap);
+	printf("\n");
+	fflush(stdout);
+}
+
 /* Sets the player state and honks accordingly. */
 static void
 set_state(struct player *play, enum state state)
@@ -377,5 +906,5 @@ set_state(struct player *play, enum state state)
 
 	play->cstate = state;
 
-	response(R_STAT, "%s %s", STATES[pstate], STATES[state]);
+	response(R_STAT, "%s%s %s", play->tag, STATES[pstate], STATES[state]);
 }
@@ -40,6 +40,9 @@
 
 #include "cuppa/errors.h" /* enum error */
 
+#include "mixer.h"		/* struct mixer */
+#include "rack.h"		/* struct rack */
+
 /**  DATA TYPES  **************************************************************/
 
 /* The player structure contains all persistent state in the program.
@@ -58,6 +61,7 @@ struct player;
 enum state {
 	S_VOID,			/* No state (usually when player starts up) */
 	S_EJCT, 		/* No file loaded */
+	S_LOAD, 		/* File being loaded */
 	S_STOP, 		/* File loaded but not playing */
 	S_PLAY, 		/* File loaded and playing */
 	S_QUIT, 		/* Player about to quit */
@@ -70,13 +74,19 @@ enum state {
 /*----------------------------------------------------------------------------
  * Initialisation and de-initialisation
  *----------------------------------------------------------------------------*/
-enum error	player_init(struct player **pl, int driver);
+enum error
+player_init(struct player **pl,
+	    struct mixer *mx,	/* Mixer for the device to play out on */
+	    struct rack *rack,	/* Rack the player is a deck in */
+	    int deck);		/* Deck number, or -1 if the only deck */
 void		player_free(struct player *pl);	/* Deallocates a player. */
 
 /*----------------------------------------------------------------------------
  *  Main loop
  *----------------------------------------------------------------------------*/
-enum error      player_main_loop(struct player *pl);
+enum error	player_check_commands(struct player *pl);
+enum error	player_loop_iter(struct player *pl);
+int		player_loop_timeout(struct player *pl);
 
 /*----------------------------------------------------------------------------
  * Nullary commands
@@ -85,12 +95,20 @@ enum error	player_cmd_ejct(void *v_play);	/* Ejects current song. */
 enum error	player_cmd_play(void *v_play);	/* Plays song. */
 enum error	player_cmd_quit(void *v_play);	/* Closes player. */
 enum error	player_cmd_stop(void *v_play);	/* Stops song. */
+enum error	player_cmd_hist(void *v_play);	/* Sends timing histograms */
 
 /*----------------------------------------------------------------------------
  * Unary commands
  *----------------------------------------------------------------------------*/
 enum error	player_cmd_load(void *v_play, const char *path);
+enum error	player_cmd_next(void *v_play, const char *path);
 enum error	player_cmd_seek(void *v_play, const char *time_str);
+enum error	player_cmd_xfad(void *v_play, const char *arg);
+enum error	player_cmd_gain(void *v_play, const char *db_str);
+enum error	player_cmd_cart(void *v_play, const char *arg);
+enum error	player_cmd_fire(void *v_play, const char *slot_str);
+enum error	player_cmd_cntr(void *v_play, const char *secs_str);
+enum error	player_cmd_deck(void *v_play, const char *deck);
 
 /*----------------------------------------------------------------------------
  * Miscellaneous
@@ -0,0 +1,327 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  rack.c
+ *
+ *    Description:  The rack of decks (players) sharing one process
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>		/* PRIu64 */
+#include <poll.h>		/* poll, struct pollfd */
+#include <stdbool.h>		/* bool */
+#include <stdint.h>
+#include <stdio.h>		/* fopen, fprintf, setvbuf */
+#include <stdlib.h>		/* getenv */
+#include <string.h>		/* strcmp */
+#include <unistd.h>		/* STDIN_FILENO */
+
+#include "cuppa/errors.h"	/* dbug, error */
+#include "cuppa/io.h"		/* response */
+
+#include "constants.h"
+#include "event.h"
+#include "hist.h"		/* struct hist, hist_xyz */
+#include "loader.h"		/* loader_reap */
+#include "messages.h"
+#include "mixer.h"
+#include "player.h"
+#include "rack.h"
+#include "workers.h"
+
+/**  DATA TYPES  **************************************************************/
+
+struct rack {
+	struct player **decks;	/* The players, one per deck */
+	int		count;	/* Number of decks */
+	int		current;	/* Deck commands go to */
+	struct mixer  **mixers;	/* The output mixers, one per sink */
+	int		mixer_count;	/* Number of mixers */
+};
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static enum error mixer_for(struct rack *rack, const char *sink,
+			    enum AVSampleFormat fmt, struct mixer **mx);
+static bool	quitting(struct rack *rack);
+static void	quit_all(struct rack *rack);
+static int	loop_timeout(struct rack *rack);
+static void	dump_hists(struct rack *rack, const char *path);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+/* With more than one deck, decks put their number in front of everything they
+ * say of their own accord (STAT and TIME), so the client can tell them apart.
+ * With just the one, the protocol is exactly as it would be without a rack.
+ *
+ * All decks share the event pipe and the pool of decoder workers, and decks on
+ * the same sink share that sink's mixer.
+ */
+enum error
+rack_init(struct rack **rack,
+	  char *const *sinks,
+	  int decks,
+	  enum AVSampleFormat fmt)
+{
+	int		i;
+	struct mixer   *mx;
+	enum error	err = E_OK;
+
+	*rack = calloc((size_t)1, sizeof(struct rack));
+	if (*rack == NULL)
+		err = error(E_NO_MEM, "can't alloc rack");
+	if (err == E_OK) {
+		(*rack)->decks = calloc((size_t)decks, sizeof(struct player *));
+		(*rack)->mixers = calloc((size_t)decks, sizeof(struct mixer *));
+		if ((*rack)->decks == NULL || (*rack)->mixers == NULL)
+			err = error(E_NO_MEM, "can't alloc decks");
+	}
+	if (err == E_OK)
+		err = event_init();
+	if (err == E_OK)
+		err = workers_init(DECODER_THREADS);
+	for (i = 0; err == E_OK && i < decks; i++) {
+		err = mixer_for(*rack, sinks[i], fmt, &mx);
+		if (err == E_OK) {
+			err = player_init(&((*rack)->decks[i]),
+					  mx,
+					  *rack,
+					  (decks > 1 ? i : -1));
+			(*rack)->count = i + 1;
+		}
+	}
+
+	return err;
+}
+
+void
+rack_free(struct rack *rack)
+{
+	int		i;
+	const char     *hist_path;
+
+	if (rack != NULL) {
+		hist_path = getenv("PLAYSLAVE_HIST_FILE");
+		if (hist_path != NULL)
+			dump_hists(rack, hist_path);
+		/* Decks stop their decoders and leave their mixers, so must
+		 * go before the workers and the mixers
+		 */
+		for (i = 0; i < rack->count; i++)
+			player_free(rack->decks[i]);
+		free(rack->decks);
+		for (i = 0; i < rack->mixer_count; i++)
+			mixer_close(rack->mixers[i]);
+		free(rack->mixers);
+		workers_free();
+		event_free();
+		free(rack);
+	}
+}
+
+enum error
+rack_main_loop(struct rack *rack)
+{
+	int		i;
+	struct pollfd	fds[2];
+	enum error	err = E_OK;
+
+	/* poll() can only see what is still in the pipe, not what stdio has
+	 * already slurped into stdin's buffer, so don't let stdio buffer.
+	 */
+	setvbuf(stdin, NULL, _IONBF, 0);
+
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = event_fd();
+	fds[1].events = POLLIN;
+
+	response(R_OHAI, "%s", MSG_OHAI);	/* Say hello */
+	while (!quitting(rack)) {
+		/* Sleep until a command, an event from the audio threads or
+		 * the next TIME pulse, whichever comes first.
+		 */
+		if (poll(fds, 2, loop_timeout(rack)) < 0 && errno != EINTR) {
+			err = error(E_INTERNAL_ERROR, "poll failed");
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			event_drain();
+			/* Cancelled loads post when they stop, too */
+			loader_reap(false);
+		}
+		if (fds[0].revents & POLLIN)
+			err = player_check_commands(rack->decks[rack->current]);
+		else if (fds[0].revents & (POLLHUP | POLLERR)) {
+			/* Nobody left to send us commands */
+			dbug("stdin closed");
+			quit_all(rack);
+		}
+		/* TODO: Check to see if err was fatal */
+		for (i = 0; i < rack->count; i++)
+			player_loop_iter(rack->decks[i]);
+		/* Quitting any deck quits the lot */
+		if (quitting(rack))
+			quit_all(rack);
+	}
+	response(R_TTFN, "%s", MSG_TTFN);	/* Wave goodbye */
+
+	return err;
+}
+
+enum error
+rack_select(struct rack *rack, const char *deck_str)
+{
+	long		deck;
+	char           *end;
+	enum error	err = E_OK;
+
+	deck = strtol(deck_str, &end, 10);
+	if (deck_str == end || *end != '\0')
+		err = error(E_BAD_COMMAND, "expecting number");
+	else if (deck < 0 || deck >= rack->count)
+		err = error(E_BAD_COMMAND, "no such deck");
+	if (err == E_OK)
+		rack->current = (int)deck;
+
+	return err;
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* Finds the mixer for 'sink', opening it if no deck has used the sink
+ * before.
+ */
+static enum error
+mixer_for(struct rack *rack, const char *sink, enum AVSampleFormat fmt,
+	  struct mixer **mx)
+{
+	int		i;
+	enum error	err = E_OK;
+
+	*mx = NULL;
+	for (i = 0; *mx == NULL && i < rack->mixer_count; i++)
+		if (strcmp(mixer_name(rack->mixers[i]), sink) == 0)
+			*mx = rack->mixers[i];
+	if (*mx == NULL) {
+		err = mixer_open(mx, sink, fmt);
+		/* Even half-open mixers go in the list, to be closed later */
+		if (*mx != NULL)
+			rack->mixers[rack->mixer_count++] = *mx;
+	}
+	return err;
+}
+
+/* Has any deck been told to quit? */
+static bool
+quitting(struct rack *rack)
+{
+	int		i;
+	bool		quit = false;
+
+	for (i = 0; i < rack->count; i++)
+		if (player_state(rack->decks[i]) == S_QUIT)
+			quit = true;
+
+	return quit;
+}
+
+/* Quits every deck that isn't quitting already. */
+static void
+quit_all(struct rack *rack)
+{
+	int		i;
+
+	for (i = 0; i < rack->count; i++)
+		if (player_state(rack->decks[i]) != S_QUIT)
+			player_cmd_quit((void *)rack->decks[i]);
+}
+
+/* Works out how long, in milliseconds, the main loop may sleep before some
+ * deck needs to send a TIME pulse; -1 (indefinitely) if none do.
+ */
+static int
+loop_timeout(struct rack *rack)
+{
+	int		i;
+	int		t;
+	int		timeout = -1;
+
+	for (i = 0; i < rack->count; i++) {
+		t = player_loop_timeout(rack->decks[i]);
+		if (t >= 0 && (timeout < 0 || t < timeout))
+			timeout = t;
+	}
+	return timeout;
+}
+
+/* Writes out every non-empty bucket of every sink's timing histograms (see
+ * sink.h) to 'path', one per line: the sink, the histogram, the lowest and
+ * highest nanoseconds the bucket covers, and how many calls fell in it.
+ */
+static void
+dump_hists(struct rack *rack, const char *path)
+{
+	int		i;
+	int		which;
+	size_t		b;
+	FILE           *f;
+	const struct hist *h;
+
+	f = fopen(path, "w");
+	if (f == NULL)
+		error(E_BAD_FILE, "can't write histograms to %s", path);
+	for (i = 0; f != NULL && i < rack->mixer_count; i++)
+		for (which = 0; which < (int)NUM_SINK_HISTS; which++) {
+			h = mixer_hist(rack->mixers[i],
+				       (enum sink_hist)which);
+			for (b = 0; b < HIST_BUCKETS; b++)
+				if (h->counts[b] > 0)
+					fprintf(f, "%s %s %" PRIu64 " %" PRIu64
+						" %" PRIu64 "\n",
+						mixer_name(rack->mixers[i]),
+						sink_hist_name(
+						      (enum sink_hist)which),
+						hist_bucket_low(b),
+						hist_bucket_high(b),
+						h->counts[b]);
+		}
+	if (f != NULL) {
+		if (fclose(f) != 0)
+			error(E_BAD_FILE, "can't write histograms to %s", path);
+		else
+			dbug("histograms written to %s", path);
+	}
+}
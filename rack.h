@@ -0,0 +1,73 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  rack.h
+ *
+ *    Description:  Interface to the rack of decks (players) sharing one process
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef RACK_H
+#define RACK_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <libavutil/samplefmt.h>	/* enum AVSampleFormat */
+
+#include "cuppa/errors.h"	/* enum error */
+
+/**  DATA TYPES  **************************************************************/
+
+/* The rack holds one or more players (decks), each playing into the mixer for
+ * its sink, and runs the main loop that feeds them commands.  Commands go to
+ * whichever deck was last picked with the deck command.
+ *
+ * struct rack is an opaque structure; only rack.c knows its true definition.
+ */
+struct rack;
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* Sets up one deck for each of the 'decks' sinks described in 'sinks' (which
+ * may repeat; see sink.h), all playing out in format 'fmt'.
+ */
+enum error
+rack_init(struct rack **rack,
+	  char *const *sinks,
+	  int decks,
+	  enum AVSampleFormat fmt);
+void		rack_free(struct rack *rack);
+
+enum error	rack_main_loop(struct rack *rack);
+
+/* Picks the deck numbered in 'deck_str' to send commands to. */
+enum error	rack_select(struct rack *rack, const char *deck_str);
+
+#endif				/* not RACK_H */
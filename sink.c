@@ -0,0 +1,723 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  sink.c
+ *
+ *    Description:  PortAudio, null and file sinks
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <errno.h>		/* EINTR */
+#include <pthread.h>
+#include <stdbool.h>		/* bool */
+#include <stdint.h>
+#include <stdio.h>		/* FILE, fopen, fwrite, setvbuf */
+#include <stdlib.h>
+#include <string.h>		/* memset, strncmp */
+#include <time.h>		/* clock_gettime, clock_nanosleep, nanosleep */
+
+#include <libavutil/samplefmt.h>
+#include <portaudio.h>
+
+#include "cuppa/errors.h"	/* dbug, error */
+#include "contrib/pa_memorybarrier.h"
+
+#include "constants.h"
+#include "counters.h"		/* counters_nsecs */
+#include "event.h"		/* event_post */
+#include "hist.h"
+#include "messages.h"		/* MSG_DEV_BADID */
+#include "sink.h"
+
+/**  MACROS  ******************************************************************/
+
+#define WAV_HEADER_SIZE 44	/* Bytes in the header we write */
+
+/**  DATA TYPES  **************************************************************/
+
+/* Kinds of sink (see sink.h). */
+enum sink_kind {
+	SK_PORTAUDIO,		/* A PortAudio device */
+	SK_NULL,		/* Nowhere */
+	SK_WAV,			/* A WAV file */
+	SK_RAW,			/* A headerless file */
+};
+
+/* PortAudio sinks are driven by PortAudio's callback; the rest (soft sinks)
+ * by a thread of our own, which either keeps time with the clock or goes
+ * flat out.
+ */
+struct sink {
+	enum sink_kind	kind;	/* What sort of sink this is */
+	sink_fn		fn;	/* Gets samples */
+	sink_ready_fn	ready;	/* Checks samples are ready */
+	void           *arg;	/* Argument to 'fn' and 'ready' */
+	double		rate;	/* Sample rate */
+	int		chans;	/* Number of channels */
+	enum AVSampleFormat fmt;	/* Sample format */
+	unsigned long	frames;	/* Samples per call of 'fn' (the period) */
+	struct hist	hists[NUM_SINK_HISTS];	/* Kept by the calling thread */
+	uint64_t	last_run;	/* When 'fn' was last called, or 0 */
+
+	/* PortAudio sinks */
+	PaStream       *stream;	/* The output stream */
+	volatile uint64_t underflows;	/* Underflows PortAudio has seen */
+
+	/* Soft sinks */
+	bool		fast;	/* Go flat out, instead of in real time? */
+	bool		unbuffered;	/* Write each buffer straight through? */
+	FILE           *file;	/* File being written, if any */
+	uint64_t	written;	/* Bytes of samples written to 'file' */
+	char           *buf;	/* Samples on their way to 'file' */
+	pthread_t	thread;	/* Thread driving the sink */
+	bool		started;	/* Is 'thread' there to be joined? */
+	volatile bool	running;	/* Cleared when the thread stops */
+	volatile bool	quit;	/* Set to make the thread stop */
+};
+
+/**  GLOBAL VARIABLES  ********************************************************/
+
+/* Names of the histograms in enum sink_hist. */
+static const char *const HIST_NAMES[NUM_SINK_HISTS] = {
+	"interval",
+	"callback",
+	"latency",
+};
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static void	run_fn(struct sink *sink, char *out, unsigned long frames);
+static enum error parse_opts(struct sink *sink, const char **spec);
+
+static enum error open_pa(struct sink *sink, const char *spec);
+static int
+pa_cb(const void *in,
+      void *out,
+      unsigned long frames_per_buf,
+      const PaStreamCallbackTimeInfo *timeInfo,
+      PaStreamCallbackFlags statusFlags,
+      void *v_sink);
+static void	pa_finished(void *v_sink);
+static enum error conv_sample_fmt(enum AVSampleFormat in, PaSampleFormat *out);
+static enum error
+setup_pa(PaSampleFormat sf, int device,
+	 int chans, PaStreamParameters *pars);
+
+static enum error open_soft(struct sink *sink, const char *spec);
+static void    *soft_main(void *v_sink);
+static void	wait_ready(struct sink *sink);
+static void	keep_time(struct sink *sink, const struct timespec *start,
+			  uint64_t bufs);
+static enum error write_wav_header(struct sink *sink);
+static void	put_le(unsigned char *dst, uint32_t val, int bytes);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+/*-----------------------------------------------------------------------------
+ *  Opening and closing
+ *----------------------------------------------------------------------------*/
+
+enum error
+sink_open(struct sink **sink,
+	  const char *spec,
+	  enum AVSampleFormat fmt,
+	  sink_fn fn,
+	  sink_ready_fn ready,
+	  void *arg)
+{
+	enum error	err = E_OK;
+
+	*sink = calloc((size_t)1, sizeof(struct sink));
+	if (*sink == NULL)
+		err = error(E_NO_MEM, "can't alloc sink");
+	if (err == E_OK) {
+		(*sink)->fn = fn;
+		(*sink)->ready = ready;
+		(*sink)->arg = arg;
+		(*sink)->fmt = fmt;
+		(*sink)->frames = SINK_PERIOD_FRAMES;
+
+		if (spec[0] >= '0' && spec[0] <= '9')
+			err = open_pa(*sink, spec);
+		else
+			err = open_soft(*sink, spec);
+	}
+	if (err == E_OK)
+		dbug("sink %s: %d channels, %s, %.0fHz, period %lu", spec,
+		     (*sink)->chans, av_get_sample_fmt_name(fmt),
+		     (*sink)->rate, (*sink)->frames);
+
+	return err;
+}
+
+void
+sink_close(struct sink *sink)
+{
+	if (sink != NULL) {
+		if (sink->stream != NULL) {
+			Pa_CloseStream(sink->stream);
+			sink->stream = NULL;
+			dbug("closed output stream");
+		}
+		if (sink->started) {
+			sink->quit = true;
+			PaUtil_WriteMemoryBarrier();
+			pthread_join(sink->thread, NULL);
+		}
+		if (sink->file != NULL) {
+			/* Now we know how much was written */
+			if (sink->kind == SK_WAV)
+				write_wav_header(sink);
+			fclose(sink->file);
+		}
+		free(sink->buf);
+		free(sink);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+ *  Running
+ *----------------------------------------------------------------------------*/
+
+/* Starts the sink calling its function, if it isn't already.  A sink that has
+ * halted by itself is started again.
+ */
+enum error
+sink_start(struct sink *sink)
+{
+	enum error	err = E_OK;
+
+	if (sink_active(sink))
+		err = E_OK;
+	else if (sink->kind == SK_PORTAUDIO) {
+		/* A stream that has halted by itself needs stopping properly
+		 * before it can be started again.
+		 */
+		if (!Pa_IsStreamStopped(sink->stream))
+			Pa_AbortStream(sink->stream);
+		/* The time spent stopped isn't an interval between calls */
+		sink->last_run = 0;
+		if (Pa_StartStream(sink->stream))
+			err = error(E_INTERNAL_ERROR, "couldn't start stream");
+	} else {
+		if (sink->started)
+			pthread_join(sink->thread, NULL);
+		sink->started = false;
+		sink->last_run = 0;
+		sink->quit = false;
+		sink->running = true;
+		PaUtil_WriteMemoryBarrier();
+		if (pthread_create(&sink->thread, NULL, soft_main,
+				   (void *)sink) != 0) {
+			sink->running = false;
+			err = error(E_INTERNAL_ERROR, "can't start sink thread");
+		} else
+			sink->started = true;
+	}
+	return err;
+}
+
+bool
+sink_active(struct sink *sink)
+{
+	bool		active;
+
+	if (sink->kind == SK_PORTAUDIO)
+		active = (Pa_IsStreamActive(sink->stream) == 1);
+	else
+		active = sink->running;
+
+	return active;
+}
+
+uint64_t
+sink_underflows(struct sink *sink)
+{
+	return sink->underflows;
+}
+
+const struct hist *
+sink_hist(struct sink *sink, enum sink_hist which)
+{
+	return &(sink->hists[which]);
+}
+
+const char     *
+sink_hist_name(enum sink_hist which)
+{
+	return HIST_NAMES[which];
+}
+
+/*-----------------------------------------------------------------------------
+ *  Simple accessors
+ *----------------------------------------------------------------------------*/
+
+double
+sink_sample_rate(struct sink *sink)
+{
+	return sink->rate;
+}
+
+int
+sink_channels(struct sink *sink)
+{
+	return sink->chans;
+}
+
+unsigned long
+sink_frames(struct sink *sink)
+{
+	return sink->frames;
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* Calls the sink's function for 'frames' samples at 'out', timing it (and
+ * the time since the last call) into the histograms.  Only the thread
+ * driving the sink may call this.
+ */
+static void
+run_fn(struct sink *sink, char *out, unsigned long frames)
+{
+	uint64_t	start = counters_nsecs();
+
+	if (sink->last_run != 0)
+		hist_record(&(sink->hists[SH_INTERVAL]),
+			    start - sink->last_run);
+	sink->last_run = start;
+
+	sink->fn(sink->arg, out, frames);
+	hist_record(&(sink->hists[SH_CALLBACK]), counters_nsecs() - start);
+}
+
+/* Reads the options at the front of '*spec', each followed by ':' unless it
+ * ends the spec, and leaves '*spec' pointing past them (at the path, if any):
+ *
+ *   fast            go flat out (soft sinks only);
+ *   period=N        ask for N samples per call, instead of SINK_PERIOD_FRAMES;
+ *   rate=N          run at N Hz, instead of SOFT_SINK_RATE (soft sinks only).
+ *
+ * Anything else is taken to be the start of the path.
+ */
+static enum error
+parse_opts(struct sink *sink, const char **spec)
+{
+	const char     *opt;
+	char           *end;
+	size_t		len;
+	unsigned long	n;
+	double		rate;
+	bool		more = true;
+	enum error	err = E_OK;
+
+	while (err == E_OK && more && **spec != '\0') {
+		opt = *spec;
+		len = strcspn(opt, ":");
+		if (len == 4 && strncmp(opt, "fast", len) == 0 &&
+		    sink->kind != SK_PORTAUDIO)
+			sink->fast = true;
+		else if (strncmp(opt, "period=", 7) == 0) {
+			n = strtoul(opt + 7, &end, 10);
+			if (end != opt + len || n == 0 ||
+			    n > SINK_MAX_PERIOD_FRAMES)
+				err = error(E_BAD_CONFIG, "bad sink period %.*s",
+					    (int)len, opt);
+			else
+				sink->frames = n;
+		} else if (strncmp(opt, "rate=", 5) == 0 &&
+			   sink->kind != SK_PORTAUDIO) {
+			rate = strtod(opt + 5, &end);
+			if (end != opt + len || !(rate >= 1.0) ||
+			    rate > SOFT_SINK_MAX_RATE)
+				err = error(E_BAD_CONFIG, "bad sink rate %.*s",
+					    (int)len, opt);
+			else
+				sink->rate = rate;
+		} else
+			more = false;
+
+		if (more)
+			*spec += (opt[len] == ':' ? len + 1 : len);
+	}
+	return err;
+}
+
+/*-----------------------------------------------------------------------------
+ *  PortAudio sinks
+ *----------------------------------------------------------------------------*/
+
+/* Opens the stream on the PortAudio device numbered in 'spec', at the
+ * device's default sample rate, with the period asked for in 'spec' (if any).
+ */
+static enum error
+open_pa(struct sink *sink, const char *spec)
+{
+	long		device;
+	char           *end;
+	PaError		pa_err;
+	PaSampleFormat	sf;
+	PaStreamParameters pars;
+	const PaDeviceInfo *dev = NULL;
+	enum error	err = E_OK;
+
+	sink->kind = SK_PORTAUDIO;
+	device = strtol(spec, &end, 10);
+	if (*end == ':') {
+		spec = end + 1;
+		err = parse_opts(sink, &spec);
+		end = (char *)spec;
+	}
+	if (err == E_OK && (*end != '\0' || device >= Pa_GetDeviceCount()))
+		err = error(E_BAD_CONFIG, MSG_DEV_BADID);
+	if (err == E_OK) {
+		dev = Pa_GetDeviceInfo((PaDeviceIndex)device);
+		if (dev == NULL || dev->maxOutputChannels < 1)
+			err = error(E_BAD_CONFIG, "device can't play audio");
+	}
+	if (err == E_OK) {
+		/* Stereo, unless the device can only do mono */
+		sink->chans = (dev->maxOutputChannels < OUT_CHANNELS ?
+			       dev->maxOutputChannels : OUT_CHANNELS);
+		sink->rate = dev->defaultSampleRate;
+
+		err = conv_sample_fmt(sink->fmt, &sf);
+	}
+	if (err == E_OK)
+		err = setup_pa(sf, (int)device, sink->chans, &pars);
+	/* A short period, with the device's low latency, keeps the time from
+	 * a command to it being heard down; PortAudio adds buffers of its
+	 * own if the device needs more.
+	 */
+	if (err == E_OK) {
+		/* Sources can add up to more than full scale, so leave
+		 * PortAudio's clipping on.
+		 */
+		pa_err = Pa_OpenStream(&(sink->stream),
+				       NULL,
+				       &pars,
+				       sink->rate,
+				       sink->frames,
+				       paNoFlag,
+				       pa_cb,
+				       (void *)sink);
+		if (pa_err)
+			err = error(E_AUDIO_INIT_FAIL, "couldn't open stream");
+	}
+	/* The main loop needs waking up if the stream halts itself */
+	if (err == E_OK &&
+	    Pa_SetStreamFinishedCallback(sink->stream, pa_finished))
+		err = error(E_AUDIO_INIT_FAIL, "couldn't set finished callback");
+
+	return err;
+}
+
+/* The callback proper, which is executed in a separate thread by PortAudio
+ * once the stream is running.
+ */
+static int
+pa_cb(const void *in,
+      void *out,
+      unsigned long frames_per_buf,
+      const PaStreamCallbackTimeInfo *timeInfo,
+      PaStreamCallbackFlags statusFlags,
+      void *v_sink)
+{
+	struct sink    *sink = (struct sink *)v_sink;
+
+	in = (const void *)in;	/* Ignoring this argument */
+
+	if (statusFlags & paOutputUnderflow)
+		sink->underflows++;
+	/* Some host APIs leave the times at 0 */
+	if (timeInfo != NULL &&
+	    timeInfo->outputBufferDacTime > timeInfo->currentTime)
+		hist_record(&(sink->hists[SH_LATENCY]),
+			    (uint64_t)((timeInfo->outputBufferDacTime -
+					timeInfo->currentTime) * 1e9));
+	run_fn(sink, (char *)out, frames_per_buf);
+	return (int)paContinue;
+}
+
+/* Called by PortAudio if the stream stops; lets the main loop know so that it
+ * can check on things.
+ */
+static void
+pa_finished(void *v_sink)
+{
+	v_sink = (void *)v_sink;	/* Ignoring this argument */
+
+	event_post();
+}
+
+/* Converts from ffmpeg sample format to PortAudio sample format.
+ *
+ * Only the output formats audio_conv can produce need to be handled.
+ */
+static enum error
+conv_sample_fmt(enum AVSampleFormat in, PaSampleFormat *out)
+{
+	enum error	err = E_OK;
+
+	switch (in) {
+	case AV_SAMPLE_FMT_S16:
+		*out = paInt16;
+		break;
+	case AV_SAMPLE_FMT_FLT:
+		*out = paFloat32;
+		break;
+	default:
+		err = error(E_BAD_CONFIG, "unusable sample format");
+	}
+
+	return err;
+}
+
+/* Sets up a PortAudio parameter set ready for converted frames to be thrown at
+ * it.
+ *
+ * The parameter set pointed to by *params MUST already be allocated, and its
+ * contents should only be used if this function returns E_OK.
+ */
+static enum error
+setup_pa(PaSampleFormat sf, int device, int chans, PaStreamParameters *pars)
+{
+	enum error	err = E_OK;	/* Nothing can go wrong atm. */
+
+	memset(pars, 0, sizeof(*pars));
+	pars->channelCount = chans;
+	pars->device = device;
+	pars->hostApiSpecificStreamInfo = NULL;
+	pars->sampleFormat = sf;
+	pars->suggestedLatency = (Pa_GetDeviceInfo(device)->
+				  defaultLowOutputLatency);
+
+	return err;
+}
+
+/*-----------------------------------------------------------------------------
+ *  Soft sinks
+ *----------------------------------------------------------------------------*/
+
+/* Sets up a null or file sink from 'spec'.  Soft sinks are always stereo, at
+ * SOFT_SINK_RATE unless 'spec' says otherwise.
+ */
+static enum error
+open_soft(struct sink *sink, const char *spec)
+{
+	const char     *opts = NULL;
+	const char     *path = NULL;
+	enum error	err = E_OK;
+
+	if (strcmp(spec, "null") == 0 || strncmp(spec, "null:", 5) == 0) {
+		sink->kind = SK_NULL;
+		opts = spec + (spec[4] == ':' ? 5 : 4);
+	} else if (strncmp(spec, "wav:", 4) == 0 ||
+		   strncmp(spec, "raw:", 4) == 0) {
+		sink->kind = (spec[0] == 'w' ? SK_WAV : SK_RAW);
+		opts = spec + 4;
+	} else if (strncmp(spec, "fifo:", 5) == 0) {
+		sink->kind = SK_RAW;
+		sink->unbuffered = true;
+		opts = spec + 5;
+	} else
+		err = error(E_BAD_CONFIG, "unknown sink %s", spec);
+
+	sink->chans = OUT_CHANNELS;
+	sink->rate = SOFT_SINK_RATE;
+	if (err == E_OK)
+		err = parse_opts(sink, &opts);
+	/* Only file sinks have anything left over */
+	if (err == E_OK) {
+		if (sink->kind == SK_NULL && *opts != '\0')
+			err = error(E_BAD_CONFIG, "unknown sink option %s",
+				    opts);
+		else if (sink->kind != SK_NULL)
+			path = opts;
+	}
+	if (err == E_OK && path != NULL && *path == '\0')
+		err = error(E_BAD_CONFIG, "no file for sink");
+	if (err == E_OK) {
+		sink->buf = malloc(sink->frames *
+				   (size_t)sink->chans *
+				   (size_t)av_get_bytes_per_sample(sink->fmt));
+		if (sink->buf == NULL)
+			err = error(E_NO_MEM, "can't alloc sink buffer");
+	}
+	/* Opening a named pipe waits here until something opens the other
+	 * end.
+	 */
+	if (err == E_OK && path != NULL) {
+		sink->file = fopen(path, "wb");
+		if (sink->file == NULL)
+			err = error(E_BAD_CONFIG, "can't open %s", path);
+	}
+	/* Whoever is reading a FIFO wants each buffer the moment it's
+	 * played, not once stdio has saved up enough of them.
+	 */
+	if (err == E_OK && sink->unbuffered &&
+	    setvbuf(sink->file, NULL, _IONBF, (size_t)0) != 0)
+		err = error(E_BAD_CONFIG, "can't unbuffer %s", path);
+	/* Leave room for the header, which is filled in properly once we
+	 * know how long the file is.
+	 */
+	if (err == E_OK && sink->kind == SK_WAV)
+		err = write_wav_header(sink);
+
+	return err;
+}
+
+/* The thread driving a soft sink, standing in for PortAudio's callback
+ * thread: it asks for a buffer of samples at a time, writing them out if
+ * there is a file, until told to stop or the file can't be written.
+ */
+static void *
+soft_main(void *v_sink)
+{
+	uint64_t	bufs;
+	size_t		bytes;
+	struct timespec	start;
+	struct sink    *sink = (struct sink *)v_sink;
+
+	bytes = (sink->frames *
+		 (size_t)sink->chans *
+		 (size_t)av_get_bytes_per_sample(sink->fmt));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (bufs = 0; !sink->quit; bufs++) {
+		if (sink->fast)
+			wait_ready(sink);
+		else
+			keep_time(sink, &start, bufs);
+		if (sink->quit)
+			break;
+
+		run_fn(sink, sink->buf, sink->frames);
+		if (sink->file != NULL) {
+			if (fwrite(sink->buf, bytes, (size_t)1,
+				   sink->file) != 1) {
+				error(E_INTERNAL_ERROR, "can't write sink file");
+				break;
+			}
+			sink->written += bytes;
+		}
+	}
+
+	sink->running = false;
+	PaUtil_WriteMemoryBarrier();
+	event_post();
+
+	return NULL;
+}
+
+/* Waits until the samples for the next buffer are ready, so that a sink going
+ * flat out doesn't outrun the decoders and play silence instead.
+ */
+static void
+wait_ready(struct sink *sink)
+{
+	struct timespec	t;
+
+	t.tv_sec = 0;
+	t.tv_nsec = SINK_POLL_NSECS;
+	while (!sink->quit && !sink->ready(sink->arg, sink->frames))
+		nanosleep(&t, NULL);
+}
+
+/* Sleeps until buffer number 'bufs' is due, counting from 'start', as a sound
+ * card would.  Times are worked out from the start each time, so they don't
+ * drift.
+ */
+static void
+keep_time(struct sink *sink, const struct timespec *start, uint64_t bufs)
+{
+	uint64_t	nsecs;
+	struct timespec	due;
+
+	nsecs = (uint64_t)(((double)bufs * (double)sink->frames * 1e9) /
+			   sink->rate);
+	due.tv_sec = start->tv_sec + (time_t)(nsecs / 1000000000);
+	due.tv_nsec = start->tv_nsec + (long)(nsecs % 1000000000);
+	if (due.tv_nsec >= 1000000000) {
+		due.tv_sec++;
+		due.tv_nsec -= 1000000000;
+	}
+	while (!sink->quit &&
+	       clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+			       &due, NULL) == EINTR)
+		;		/* Interrupted, so go back to sleep */
+}
+
+/* Writes the 44-byte canonical WAV header at the start of the file, with the
+ * lengths as they stand.  The samples are written as they are, so this
+ * assumes a little-endian machine.
+ */
+static enum error
+write_wav_header(struct sink *sink)
+{
+	unsigned char	h[WAV_HEADER_SIZE];
+	uint32_t	bps = (uint32_t)av_get_bytes_per_sample(sink->fmt);
+	uint32_t	data = (sink->written > UINT32_MAX - WAV_HEADER_SIZE ?
+				UINT32_MAX - WAV_HEADER_SIZE :
+				(uint32_t)sink->written);
+	enum error	err = E_OK;
+
+	memcpy(h, "RIFF", 4);
+	put_le(h + 4, data + WAV_HEADER_SIZE - 8, 4);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put_le(h + 16, 16, 4);
+	/* Format 3 is IEEE float, 1 integer PCM */
+	put_le(h + 20, (sink->fmt == AV_SAMPLE_FMT_FLT ? 3 : 1), 2);
+	put_le(h + 22, (uint32_t)sink->chans, 2);
+	put_le(h + 24, (uint32_t)sink->rate, 4);
+	put_le(h + 28, (uint32_t)sink->rate * (uint32_t)sink->chans * bps, 4);
+	put_le(h + 32, (uint32_t)sink->chans * bps, 2);
+	put_le(h + 34, bps * 8, 2);
+	memcpy(h + 36, "data", 4);
+	put_le(h + 40, data, 4);
+
+	if (fseek(sink->file, 0L, SEEK_SET) != 0 ||
+	    fwrite(h, sizeof(h), (size_t)1, sink->file) != 1)
+		err = error(E_INTERNAL_ERROR, "can't write WAV header");
+
+	return err;
+}
+
+static void
+put_le(unsigned char *dst, uint32_t val, int bytes)
+{
+	int		i;
+
+	for (i = 0; i < bytes; i++)
+		dst[i] = (unsigned char)((val >> (8 * i)) & 0xFF);
+}
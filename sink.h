@@ -0,0 +1,133 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  sink.h
+ *
+ *    Description:  Interface to the places mixed audio goes
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef SINK_H
+#define SINK_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+#include <stdint.h>		/* uint64_t */
+
+#include <libavutil/samplefmt.h>	/* enum AVSampleFormat */
+
+#include "cuppa/errors.h"	/* enum error */
+
+#include "hist.h"		/* struct hist */
+
+/**  TYPEDEFS  ****************************************************************/
+
+/* The function a sink calls, from a thread of its own, each time it wants
+ * another 'frames' samples at 'out'.  It MUST NOT block.
+ */
+typedef void	(*sink_fn) (void *arg, char *out, unsigned long frames);
+
+/* The function a sink running faster than real time calls to check that the
+ * next 'frames' samples are ready, so that it can wait for them instead of
+ * playing silence.  Sinks paced by a clock never call it.
+ */
+typedef bool	(*sink_ready_fn) (void *arg, unsigned long frames);
+
+/**  DATA TYPES  **************************************************************/
+
+/* The timing histograms every sink keeps of its callback, in nanoseconds. */
+enum sink_hist {
+	SH_INTERVAL,		/* From the start of one call to the next */
+	SH_CALLBACK,		/* Spent in each call */
+	SH_LATENCY,		/* From each call to its samples reaching the
+				 * DAC, as PortAudio reckons it (PortAudio
+				 * sinks only) */
+	NUM_SINK_HISTS		/* Number of items in enum */
+};
+
+/* A sink is somewhere mixed audio is played out, and the clock that decides
+ * when; it might be a PortAudio device, or something that needs no sound
+ * hardware at all:
+ *
+ *   3               PortAudio device 3;
+ *   null            throws samples away, at the rate a device would;
+ *   null:fast       throws samples away, as fast as they come;
+ *   wav:PATH        writes samples to a WAV file at PATH, in real time;
+ *   wav:fast:PATH   writes samples to a WAV file as fast as they come;
+ *   raw:PATH        writes bare samples (in the machine's byte order);
+ *   raw:fast:PATH   likewise, as fast as they come;
+ *   fifo:PATH       writes bare samples, unbuffered, in real time, to a
+ *                   named pipe (say) that something else is listening to.
+ *
+ * Any sink can also be given 'period=N' before its path (as in 3:period=128
+ * or wav:fast:period=4096:PATH) to be asked for N samples at a time instead
+ * of SINK_PERIOD_FRAMES; shorter periods mean less latency but more calls.
+ * Sinks other than PortAudio devices can be given 'rate=N' likewise (as in
+ * null:rate=44100 or wav:rate=96000:PATH) to run at N Hz instead of
+ * SOFT_SINK_RATE.
+ *
+ * struct sink is an opaque structure; only sink.c knows its true definition.
+ */
+struct sink;
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* Opens the sink described by 'spec' (see above), to play samples of format
+ * 'fmt', fetching them by calling 'fn' (and 'ready') on 'arg'.  It doesn't
+ * call either until started.
+ */
+enum error
+sink_open(struct sink **sink,
+	  const char *spec,
+	  enum AVSampleFormat fmt,
+	  sink_fn fn,
+	  sink_ready_fn ready,
+	  void *arg);
+void		sink_close(struct sink *sink);
+
+enum error	sink_start(struct sink *sink);	/* Starts, or restarts, sink */
+bool		sink_active(struct sink *sink);	/* Is the sink running? */
+
+/* Times the sink has said it ran out of samples (output underflows reported
+ * by PortAudio); soft sinks never do.
+ */
+uint64_t	sink_underflows(struct sink *sink);
+
+/* The sink's timing histograms, which count up from when it was opened */
+const struct hist *sink_hist(struct sink *sink, enum sink_hist which);
+const char     *sink_hist_name(enum sink_hist which);
+
+/* The fixed properties of the sink */
+double		sink_sample_rate(struct sink *sink);
+int		sink_channels(struct sink *sink);
+unsigned long	sink_frames(struct sink *sink);	/* Most samples per call */
+
+#endif				/* not SINK_H */
@@ -0,0 +1,294 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  workers.c
+ *
+ *    Description:  The pool of decoder worker threads
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#define _POSIX_C_SOURCE 200809
+
+/**  INCLUDES  ****************************************************************/
+
+#include <errno.h>		/* EINTR */
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>		/* bool */
+#include <stdlib.h>		/* calloc, realloc, free */
+
+#include "cuppa/errors.h"	/* dbug, error */
+
+#include "workers.h"
+
+/**  DATA TYPES  **************************************************************/
+
+struct job {
+	job_fn		fn;	/* The job, or NULL if the slot is free */
+	void           *arg;	/* Argument to 'fn', identifying the job */
+	bool		running;	/* Is a worker running it right now? */
+};
+
+/**  GLOBAL VARIABLES  ********************************************************/
+
+/* Everything below is protected by LOCK, apart from WAKE. */
+static pthread_mutex_t LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t IDLE = PTHREAD_COND_INITIALIZER;	/* A job finished */
+
+/* Job slots.  A job keeps its slot until removed, so workers can keep hold
+ * of the index of a job while running it without the lock.
+ */
+static struct job *JOBS = NULL;
+static size_t	NUM_JOBS = 0;
+
+static pthread_t *THREADS = NULL;
+static int	NUM_THREADS = 0;
+static bool	QUIT = false;
+
+/* Bumped each time a job has had work to do.  A job that found nothing to do
+ * while this changed under it may have been looking at stale state, so is
+ * given another go.
+ */
+static unsigned int PROGRESS = 0;
+
+/* Posted by every workers_wake, and waited on by idle workers.  Unlike a
+ * condition variable, it remembers a post made just before a worker starts
+ * waiting, and posting it needs no lock, so the callback can do it.
+ */
+static sem_t	WAKE;
+
+/**  STATIC PROTOTYPES  *******************************************************/
+
+static void    *worker_main(void *unused);
+static bool	worker_pass(size_t *start);
+static void	worker_wait(void);
+
+/**  PUBLIC FUNCTIONS  ********************************************************/
+
+enum error
+workers_init(int threads)
+{
+	enum error	err = E_OK;
+
+	if (sem_init(&WAKE, 0, 0) != 0)
+		err = error(E_INTERNAL_ERROR, "can't make worker semaphore");
+	if (err == E_OK) {
+		THREADS = calloc((size_t)threads, sizeof(pthread_t));
+		if (THREADS == NULL)
+			err = error(E_NO_MEM, "can't alloc worker threads");
+	}
+	QUIT = false;
+	for (; err == E_OK && NUM_THREADS < threads; NUM_THREADS++) {
+		if (pthread_create(&THREADS[NUM_THREADS],
+				   NULL, worker_main, NULL) != 0)
+			err = error(E_INTERNAL_ERROR, "couldn't start worker");
+	}
+	if (err == E_OK)
+		dbug("%d decoder workers", NUM_THREADS);
+
+	return err;
+}
+
+/* Stops and waits for the workers.  All jobs should have been removed. */
+void
+workers_free(void)
+{
+	int		i;
+
+	pthread_mutex_lock(&LOCK);
+	QUIT = true;
+	pthread_mutex_unlock(&LOCK);
+
+	/* Each worker passes this on as it quits (see worker_main) */
+	sem_post(&WAKE);
+	for (i = 0; i < NUM_THREADS; i++)
+		pthread_join(THREADS[i], NULL);
+	sem_destroy(&WAKE);
+	NUM_THREADS = 0;
+	free(THREADS);
+	THREADS = NULL;
+	free(JOBS);
+	JOBS = NULL;
+	NUM_JOBS = 0;
+}
+
+/* Adds a job, which will be run by the workers, over and over, until removed
+ * with workers_remove.  'arg' identifies the job, so must be unique.
+ */
+enum error
+workers_add(job_fn fn, void *arg)
+{
+	size_t		i;
+	struct job     *jobs;
+	enum error	err = E_OK;
+
+	pthread_mutex_lock(&LOCK);
+	for (i = 0; i < NUM_JOBS && JOBS[i].fn != NULL; i++);
+	if (i == NUM_JOBS) {
+		/* No free slots, so make some.  Workers only touch the
+		 * slots with the lock held, so moving them is fine.
+		 */
+		jobs = realloc(JOBS, (NUM_JOBS + 1) * 2 * sizeof(struct job));
+		if (jobs == NULL)
+			err = error(E_NO_MEM, "can't alloc worker jobs");
+		else {
+			JOBS = jobs;
+			for (; NUM_JOBS < (i + 1) * 2; NUM_JOBS++)
+				JOBS[NUM_JOBS].fn = NULL;
+		}
+	}
+	if (err == E_OK) {
+		JOBS[i].fn = fn;
+		JOBS[i].arg = arg;
+		JOBS[i].running = false;
+	}
+	pthread_mutex_unlock(&LOCK);
+	if (err == E_OK)
+		sem_post(&WAKE);
+
+	return err;
+}
+
+/* Removes the job identified by 'arg', waiting for any worker running it to
+ * finish, so that once this returns the job will never run again.
+ */
+void
+workers_remove(void *arg)
+{
+	size_t		i;
+
+	pthread_mutex_lock(&LOCK);
+	for (i = 0; i < NUM_JOBS; i++) {
+		if (JOBS[i].fn != NULL && JOBS[i].arg == arg) {
+			while (JOBS[i].running)
+				pthread_cond_wait(&IDLE, &LOCK);
+			JOBS[i].fn = NULL;
+			JOBS[i].arg = NULL;
+		}
+	}
+	pthread_mutex_unlock(&LOCK);
+}
+
+/* Lets the workers know that some job may have work to do.
+ *
+ * This never blocks, so it is safe to call from the playing callback.  A
+ * worker that was just about to go to sleep still sees the wake-up, as the
+ * semaphore keeps count.
+ */
+void
+workers_wake(void)
+{
+	sem_post(&WAKE);
+}
+
+/**  STATIC FUNCTIONS  ********************************************************/
+
+/* The body of each worker thread.
+ *
+ * Workers go round the jobs running each in turn, and sleep once a whole pass
+ * finds nothing to do, until workers_wake says there might be.  There is no
+ * timeout: with nothing to do, they don't wake up at all.
+ */
+static void *
+worker_main(void *unused)
+{
+	size_t		start = 0;
+
+	unused = (void *)unused;	/* Ignoring this argument */
+
+	pthread_mutex_lock(&LOCK);
+	while (!QUIT) {
+		if (!worker_pass(&start) && !QUIT)
+			worker_wait();
+	}
+	pthread_mutex_unlock(&LOCK);
+	/* A waking worker takes every post, so wake the next one to quit */
+	sem_post(&WAKE);
+
+	return NULL;
+}
+
+/* Runs each job that no other worker is running once, starting from slot
+ * '*start' so that, between them, the workers don't keep favouring the same
+ * jobs.  Call with the lock held.  Returns true if any job had work to do, or
+ * found none while some other job did (see PROGRESS).
+ */
+static bool
+worker_pass(size_t *start)
+{
+	size_t		n;
+	size_t		i;
+	job_fn		fn;
+	void           *arg;
+	unsigned int	progress;
+	bool		busy = false;
+
+	for (n = 0; n < NUM_JOBS && !QUIT; n++) {
+		i = (*start + n) % NUM_JOBS;
+		if (JOBS[i].fn != NULL && !JOBS[i].running) {
+			fn = JOBS[i].fn;
+			arg = JOBS[i].arg;
+			JOBS[i].running = true;
+			progress = PROGRESS;
+			pthread_mutex_unlock(&LOCK);
+
+			if (fn(arg)) {
+				pthread_mutex_lock(&LOCK);
+				PROGRESS++;
+				busy = true;
+			} else {
+				pthread_mutex_lock(&LOCK);
+				busy = busy || (PROGRESS != progress);
+			}
+			JOBS[i].running = false;
+			pthread_cond_broadcast(&IDLE);
+		}
+	}
+	if (NUM_JOBS > 0)
+		*start = (*start + 1) % NUM_JOBS;
+
+	return busy;
+}
+
+/* Sleeps until woken.  Call with the lock held.
+ *
+ * Any other wake-ups already posted are taken too, as the pass this worker is
+ * about to make covers them all.
+ */
+static void
+worker_wait(void)
+{
+	pthread_mutex_unlock(&LOCK);
+	while (sem_wait(&WAKE) != 0 && errno == EINTR)
+		;		/* Interrupted, so go back to sleep */
+	while (sem_trywait(&WAKE) == 0)
+		;
+	pthread_mutex_lock(&LOCK);
+}
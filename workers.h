@@ -0,0 +1,67 @@
+/*
+ * =============================================================================
+ *
+ *       Filename:  workers.h
+ *
+ *    Description:  Interface to the pool of decoder worker threads
+ *
+ *        Version:  1.0
+ *        Created:  17/10/2026 12:00:00
+ *       Revision:  none
+ *       Compiler:  clang
+ *
+ *         Author:  Matt Windsor (CaptainHayashi), matt.windsor@ury.org.uk
+ *        Company:  University Radio York Computing Team
+ *
+ * =============================================================================
+ */
+/*-
+ * Copyright (C) 2012  University Radio York Computing Team
+ *
+ * This file is a part of playslave.
+ *
+ * playslave is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * playslave is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * playslave; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+/**  INCLUDES  ****************************************************************/
+
+#include <stdbool.h>		/* bool */
+
+#include "cuppa/errors.h"	/* enum error */
+
+/**  DATA TYPES  **************************************************************/
+
+/* A job is a function that does a turn of some ongoing work (decoding, for
+ * one) without blocking for long, and returns true if there was anything to
+ * do.  Jobs that return false aren't run again until workers_wake is called,
+ * or another job has had work to do while they ran.
+ */
+typedef bool	(*job_fn) (void *arg);
+
+/**  FUNCTIONS  ***************************************************************/
+
+/* The worker pool is a fixed set of threads shared by all jobs, so that the
+ * number of threads doesn't grow with the number of files loaded.
+ */
+enum error	workers_init(int threads);	/* Starts the workers */
+void		workers_free(void);	/* Stops the workers */
+
+enum error	workers_add(job_fn fn, void *arg);	/* Adds a job */
+void		workers_remove(void *arg);	/* Removes a job */
+void		workers_wake(void);	/* There may be work to do */
+
+#endif				/* not WORKERS_H */